@@ -17,6 +17,10 @@
 #include "Log.h"
 #include "Profiler.h"
 #include "GLFrame.h"
+#include "vglutil.h"
+#include "Timer.h"
+#include <unistd.h>
+#include <stdarg.h>
 
 using namespace vglutil;
 using namespace vglcommon;
@@ -25,33 +29,96 @@ using namespace vglclient;
 
 extern Display *maindpy;
 
+ClientWin *ClientWin::first = NULL;
+CriticalSection ClientWin::listMutex;
+
 
 ClientWin::ClientWin(int dpynum_, Window window_, int drawMethod_,
-	bool stereo_) : drawMethod(drawMethod_), reqDrawMethod(drawMethod_),
-	fb(NULL), cfindex(0), deadYet(false), thread(NULL), stereo(stereo_)
+	int nprocs_, int nbufs, bool stereo_, DecodePool *pool_) :
+	drawMethod(drawMethod_),
+	reqDrawMethod(drawMethod_), fb(NULL), cframes(NULL), nCFrames(nbufs),
+	deadYet(false), thread(NULL), pendingFrames(0), spoil(true),
+	stereo(stereo_), damage(NULL), nDamage(0), maxDamage(0), fullDamage(true),
+	damageWidth(0), damageHeight(0), nprocs(nprocs_), nDispatched(0),
+	decomp(NULL), dthread(NULL), fbValid(false), pool(pool_), held(NULL),
+	inflight(0), nTasks(0), busy(false), stalled(false), poolBytes(0),
+	profTotal("Total     "), profBlit("Blit      "), recvStart(0.0),
+	framesDrawn(0), framesSpoiled(0), prev(NULL), next(NULL)
 {
+	char *env = NULL;
+
 	if(dpynum_ < 0 || dpynum_ > 65535 || !window_)
 		throw(Error("ClientWin::ClientWin()", "Invalid argument"));
 	dpynum = dpynum_;  window = window_;
 
 	#ifdef USEXV
 	for(int i = 0; i < NFRAMES; i++) xvframes[i] = NULL;
+	xvindex = 0;
 	#endif
+	if((env = getenv("VGLCLIENT_SPOIL")) != NULL && !strncmp(env, "0", 1))
+		spoil = false;
+	if(nprocs < 1) nprocs = 1;
+	if(nCFrames < NFRAMES) nCFrames = NFRAMES;
+	NEWCHECK(cframes = new CompressedFrame[nCFrames]);
+	for(int i = 0; i < nCFrames; i++) cfPool.add(&cframes[i]);
 	if(drawMethod == RR_DRAWAUTO) drawMethod = RR_DRAWX11;
 	if(stereo) drawMethod = RR_DRAWOGL;
 	initGL();
 	initX11();
+	profTotal.setHistogram(&frameHist);
+	profBlit.setHistogram(&blitHist);
 
-	NEWCHECK(thread = new Thread(this));
-	thread->start();
+	listMutex.lock();
+	next = first;
+	if(first) first->prev = this;
+	first = this;
+	listMutex.unlock();
+
+	if(!pool)
+	{
+		NEWCHECK(thread = new Thread(this));
+		thread->start();
+	}
 }
 
 
 ClientWin::~ClientWin(void)
 {
+	listMutex.lock();
+	if(prev) prev->next = next;
+	else if(first == this) first = next;
+	if(next) next->prev = prev;
+	prev = next = NULL;
+	listMutex.unlock();
+
+	if(pool)
+	{
+		// Wait for any tasks that the pool is running on behalf of this window
+		cfmutex.lock();
+		deadYet = true;
+		while(nTasks > 0)
+		{
+			cfmutex.unlock();
+			tasksDone.wait();
+			cfmutex.lock();
+		}
+		cfmutex.unlock();
+	}
 	deadYet = true;
 	q.release();
+	cfPool.release();
 	if(thread) thread->stop();
+	tileQ.release();
+	if(dthread)
+	{
+		for(int i = 0; i < nprocs; i++)
+		{
+			if(dthread[i]) { dthread[i]->stop();  delete dthread[i]; }
+			delete decomp[i];
+		}
+		delete [] dthread;  dthread = NULL;
+		delete [] decomp;  decomp = NULL;
+	}
 	delete fb;  fb = NULL;
 	#ifdef USEXV
 	for(int i = 0; i < NFRAMES; i++)
@@ -62,7 +129,8 @@ ClientWin::~ClientWin(void)
 		}
 	}
 	#endif
-	for(int i = 0; i < NFRAMES; i++) cframes[i].signalComplete();
+	delete [] cframes;  cframes = NULL;
+	free(damage);  damage = NULL;
 	delete thread;  thread = NULL;
 }
 
@@ -100,6 +168,7 @@ void ClientWin::initGL(void)
 			else delete ((FBXFrame *)fb);
 		}
 		fb = (Frame *)newfb;
+		fullDamage = true;
 	}
 }
 
@@ -132,6 +201,7 @@ void ClientWin::initX11(void)
 			else delete ((FBXFrame *)fb);
 		}
 		fb = (Frame *)newfb;
+		fullDamage = true;
 	}
 }
 
@@ -142,66 +212,191 @@ int ClientWin::match(int dpynum_, Window window_)
 }
 
 
-Frame *ClientWin::getFrame(bool useXV)
+// If wait is false, then this returns NULL rather than blocking if no receive
+// buffers are available.  In that case, the DecodePool's wake file descriptor
+// is written to once a buffer becomes available.
+Frame *ClientWin::getFrame(bool useXV, bool wait)
 {
 	Frame *f = NULL;
 
 	if(thread) thread->checkError();
-	cfmutex.lock();
+	checkPoolError();
+	if(recvStart == 0.0) recvStart = Timer().time();
 	#ifdef USEXV
 	if(useXV)
 	{
-		if(!xvframes[cfindex])
+		cfmutex.lock();
+		if(!xvframes[xvindex])
 		{
 			char dpystr[80];
 			sprintf(dpystr, ":%d.0", dpynum);
-			NEWCHECK(xvframes[cfindex] = new XVFrame(dpystr, window));
-			if(!xvframes[cfindex]) THROW("Could not allocate class instance");
+			NEWCHECK(xvframes[xvindex] = new XVFrame(dpystr, window));
+			if(!xvframes[xvindex]) THROW("Could not allocate class instance");
+		}
+		f = (Frame *)xvframes[xvindex];
+		if(!wait && !f->isComplete())
+		{
+			stalled = true;
+			cfmutex.unlock();
+			return NULL;
 		}
-		f = (Frame *)xvframes[cfindex];
+		xvindex = (xvindex + 1) % NFRAMES;
+		cfmutex.unlock();
+		f->waitUntilComplete();
 	}
 	else
 	#endif
-	f = (Frame *)&cframes[cfindex];
-	cfindex = (cfindex + 1) % NFRAMES;
-	cfmutex.unlock();
-	f->waitUntilComplete();
+	{
+		void *ftemp = NULL;
+		if(wait) cfPool.get(&ftemp);
+		else
+		{
+			CriticalSection::SafeLock l(cfmutex);
+			cfPool.get(&ftemp, true);
+			if(!ftemp)
+			{
+				stalled = true;
+				return NULL;
+			}
+		}
+		f = (Frame *)ftemp;
+	}
 	if(thread) thread->checkError();
+	if(!f) THROW("Receive buffer pool has been released");
 	return f;
 }
 
 
 void ClientWin::drawFrame(Frame *f)
 {
+	if(f->isXV ? f->hdr.flags != RR_EOF : f->hdr.flags == RR_EOF)
+	{
+		if(recvStart != 0.0) recvHist.add(Timer().time() - recvStart);
+		recvStart = 0.0;
+	}
+	if(pool)
+	{
+		submit(f);
+		return;
+	}
 	if(thread) thread->checkError();
-	if(!f->isXV)
+	if(!f->isXV && f->hdr.flags == RR_EOF)
 	{
-		CompressedFrame *c = (CompressedFrame *)f;
-		if((c->rhdr.flags == RR_RIGHT || c->hdr.flags == RR_LEFT) && !stereo)
+		CriticalSection::SafeLock l(cfmutex);
+		pendingFrames++;
+	}
+	q.add(f);
+}
+
+
+// Switch to/from OpenGL drawing if the stereo state of the frame has changed.
+// This is done in the window thread, so that the back buffer is not replaced
+// while the tiles in a frame are being decompressed into it.
+bool ClientWin::stereoChanged(CompressedFrame *c)
+{
+	return ((c->rhdr.flags == RR_RIGHT || c->hdr.flags == RR_LEFT) && !stereo)
+		|| (c->hdr.flags == 0 && stereo);
+}
+
+
+void ClientWin::checkStereo(CompressedFrame *c)
+{
+	if((c->rhdr.flags == RR_RIGHT || c->hdr.flags == RR_LEFT) && !stereo)
+	{
+		joinDecompressors();
+		stereo = true;
+		if(drawMethod != RR_DRAWOGL)
 		{
-			stereo = true;
-			if(drawMethod != RR_DRAWOGL)
-			{
-				drawMethod = RR_DRAWOGL;
-				initGL();
-			}
+			drawMethod = RR_DRAWOGL;
+			initGL();
+		}
+	}
+	if((c->hdr.flags == 0) && stereo)
+	{
+		joinDecompressors();
+		stereo = false;
+		drawMethod = reqDrawMethod;
+		if(drawMethod == RR_DRAWAUTO) drawMethod = RR_DRAWX11;
+		initX11();
+	}
+}
+
+
+// The back buffer is reinitialized (with no tiles being decompressed into it)
+// at the start of each frame and whenever the frame geometry or pixel format
+// would change.
+bool ClientWin::fbChanged(CompressedFrame *c)
+{
+	return !fbValid || c->hdr.framew != fbhdr.framew
+		|| c->hdr.frameh != fbhdr.frameh
+		|| (c->hdr.compress == RRCOMP_RGB) != (fbhdr.compress == RRCOMP_RGB)
+		|| c->stereo != fb->stereo;
+}
+
+
+void ClientWin::initFB(CompressedFrame *c)
+{
+	if(fb->isGL) ((GLFrame *)fb)->init(c->hdr, c->stereo);
+	else ((FBXFrame *)fb)->init(c->hdr);
+	fbhdr = c->hdr;  fbValid = true;
+}
+
+
+void ClientWin::startDecompressors(void)
+{
+	NEWCHECK(decomp = new Decompressor *[nprocs]);
+	NEWCHECK(dthread = new Thread *[nprocs]);
+	memset(decomp, 0, sizeof(Decompressor *) * nprocs);
+	memset(dthread, 0, sizeof(Thread *) * nprocs);
+	for(int i = 0; i < nprocs; i++)
+	{
+		NEWCHECK(decomp[i] = new Decompressor(this));
+		NEWCHECK(dthread[i] = new Thread(decomp[i]));
+		dthread[i]->start();
+	}
+}
+
+
+// Wait for all of the tiles that have been dispatched to the decompression
+// threads to be decompressed.
+void ClientWin::joinDecompressors(void)
+{
+	for(; nDispatched > 0; nDispatched--) tileDone.wait();
+	if(dthread)
+		for(int i = 0; i < nprocs; i++) dthread[i]->checkError();
+}
+
+
+void ClientWin::Decompressor::run(void)
+{
+	while(1)
+	{
+		void *ftemp = NULL;
+		parent->tileQ.get(&ftemp);  if(!ftemp) break;
+		CompressedFrame *c = (CompressedFrame *)ftemp;
+
+		try
+		{
+			if(!lastError) parent->decompressTile(c, tjhnd);
 		}
-		if((c->hdr.flags == 0) && stereo)
+		catch(Error &e)
 		{
-			stereo = false;
-			drawMethod = reqDrawMethod;
-			if(drawMethod == RR_DRAWAUTO) drawMethod = RR_DRAWX11;
-			initX11();
+			lastError = e;
 		}
+		c->releaseShared();
+		parent->cfPool.add(c);
+		parent->tileDone.post();
 	}
-	q.add(f);
 }
 
 
 void ClientWin::run(void)
 {
 	Profiler pt("Total     "), pb("Blit      "), pd("Decompress");
-	Frame *f = NULL;  long bytes = 0;
+	Frame *f = NULL;  long bytes = 0, pixels = 0;
+
+	pt.setHistogram(&frameHist);
+	pb.setHistogram(&blitHist);
 
 	try
 	{
@@ -211,12 +406,14 @@ void ClientWin::run(void)
 			q.get(&ftemp);  f = (Frame *)ftemp;  if(deadYet) break;
 			if(!f)
 				throw(Error("ClientWin::run()", "Invalid image received from queue"));
+			pt.addQueueDepth(q.items());
 			CriticalSection::SafeLock l(mutex);
 			#ifdef USEXV
 			if(f->isXV)
 			{
 				if(f->hdr.flags != RR_EOF)
 				{
+					cfmutex.lock();  framesDrawn++;  cfmutex.unlock();
 					pb.startFrame();
 					((XVFrame *)f)->redraw();
 					pb.endFrame(f->hdr.width * f->hdr.height, 0, 1);
@@ -228,37 +425,537 @@ void ClientWin::run(void)
 			else
 			#endif
 			{
+				CompressedFrame *c = (CompressedFrame *)f;
+				checkStereo(c);
 				if(f->hdr.flags == RR_EOF)
 				{
+					bool spoiled;
+					cfmutex.lock();
+					pendingFrames--;
+					spoiled = spoil && pendingFrames > 0;
+					if(spoiled) framesSpoiled++;
+					else framesDrawn++;
+					cfmutex.unlock();
+
+					if(nDispatched > 0)
+					{
+						joinDecompressors();
+						pd.endFrame(pixels, 0,
+							(double)pixels / (double)(f->hdr.framew * f->hdr.frameh));
+					}
+					fbValid = false;  pixels = 0;
+					if(spoiled)
+					{
+						pt.endFrame(0, bytes, 0);
+						bytes = 0;
+						pt.startFrame();
+						recycle(f);
+						continue;
+					}
 					pb.startFrame();
 					if(fb->isGL) ((GLFrame *)fb)->init(f->hdr, stereo);
 					else ((FBXFrame *)fb)->init(f->hdr);
-					if(fb->isGL) ((GLFrame *)fb)->redraw();
-					else ((FBXFrame *)fb)->redraw();
-					pb.endFrame(fb->hdr.framew * fb->hdr.frameh, 0, 1);
+					pb.endFrame(drawDamage(), 0, 1);
 					pt.endFrame(fb->hdr.framew * fb->hdr.frameh, bytes, 1);
 					bytes = 0;
 					pt.startFrame();
 				}
+				else if(nprocs > 1)
+				{
+					if(!c->bits || c->hdr.size < 1) THROW("JPEG not initialized");
+					if(fbChanged(c))
+					{
+						if(nDispatched > 0) joinDecompressors();
+						else pd.startFrame();
+						initFB(c);
+					}
+					if(!dthread) startDecompressors();
+					addDamage(c->hdr);
+					pixels += c->hdr.width * c->hdr.height;
+					bytes += c->hdr.size;
+					pd.addQueueDepth(tileQ.items());
+					nDispatched++;
+					tileQ.add(c);  f = NULL;
+					continue;
+				}
 				else
 				{
 					pd.startFrame();
-					if(fb->isGL) *((GLFrame *)fb) = *((CompressedFrame *)f);
-					else *((FBXFrame *)fb) = *((CompressedFrame *)f);
+					decompressTile(c, NULL);
+					addDamage(c->hdr);
 					pd.endFrame(f->hdr.width * f->hdr.height, 0,
 						(double)(f->hdr.width * f->hdr.height) /
 							(double)(f->hdr.framew * f->hdr.frameh));
 					bytes += f->hdr.size;
 				}
 			}
-			f->signalComplete();
+			recycle(f);
 		}
 
 	}
 	catch(Error &e)
 	{
 		if(thread) thread->setError(e);
-		if(f) f->signalComplete();
+		if(f) recycle(f);
+		// Wake up the listener thread if it is waiting for a receive buffer, so
+		// it can report the error.
+		cfPool.release();
 		throw;
 	}
 }
+
+
+void ClientWin::recycle(Frame *f)
+{
+	CriticalSection::SafeLock l(cfmutex);
+
+	if(f->isXV) f->signalComplete();
+	else
+	{
+		// Return the batch from which the tile was decompressed (if any) to the
+		// listener's pool as soon as possible.
+		((CompressedFrame *)f)->releaseShared();
+		cfPool.add(f);
+	}
+	if(stalled && pool)
+	{
+		stalled = false;
+		pool->wake();
+	}
+}
+
+
+void ClientWin::checkPoolError(void)
+{
+	if(pool)
+	{
+		CriticalSection::SafeLock l(cfmutex);
+		if(poolError) throw(poolError);
+	}
+}
+
+
+void ClientWin::submit(Frame *f)
+{
+	checkPoolError();
+	CriticalSection::SafeLock l(cfmutex);
+	if(!f->isXV && f->hdr.flags == RR_EOF) pendingFrames++;
+	pending.add(f);
+	pump();
+}
+
+
+// Pass as many pending frames as possible to the pool, in order.  The frame at
+// the head of the queue is held if it cannot be processed until the tasks that
+// were previously dispatched have completed.  This is called with cfmutex
+// locked, whenever a frame is submitted or a task completes.
+void ClientWin::pump(void)
+{
+	while(!busy && !deadYet && !poolError)
+	{
+		Frame *f = held;
+		if(!f)
+		{
+			void *ftemp = NULL;
+			pending.get(&ftemp, true);  f = (Frame *)ftemp;
+			if(!f) break;
+		}
+		held = NULL;
+
+		try
+		{
+			#ifdef USEXV
+			if(f->isXV)
+			{
+				if(f->hdr.flags == RR_EOF) { recycle(f);  continue; }
+				if(inflight > 0) { held = f;  break; }
+				busy = true;
+				framesDrawn++;
+				dispatch(f);
+				continue;
+			}
+			#endif
+			CompressedFrame *c = (CompressedFrame *)f;
+			if(f->hdr.flags == RR_EOF)
+			{
+				if(inflight > 0) { held = f;  break; }
+				pendingFrames--;
+				fbValid = false;
+				if(spoil && pendingFrames > 0)
+				{
+					framesSpoiled++;
+					profTotal.endFrame(0, poolBytes, 0);
+					poolBytes = 0;
+					profTotal.startFrame();
+					recycle(f);
+					continue;
+				}
+				busy = true;
+				framesDrawn++;
+				dispatch(f);
+				continue;
+			}
+			if(!c->bits || c->hdr.size < 1) THROW("JPEG not initialized");
+			if(stereoChanged(c) || fbChanged(c))
+			{
+				if(inflight > 0) { held = f;  break; }
+				checkStereo(c);
+				initFB(c);
+			}
+			addDamage(c->hdr);
+			poolBytes += c->hdr.size;
+			inflight++;
+			dispatch(f);
+		}
+		catch(Error &e)
+		{
+			poolError = e;
+			recycle(f);
+		}
+	}
+}
+
+
+void ClientWin::dispatch(Frame *f)
+{
+	nTasks++;
+	readyQ.add(f);
+	pool->add(this);
+}
+
+
+// Called by a DecodePool thread to decompress a tile or draw a frame that was
+// previously dispatched by pump().
+void ClientWin::runTask(tjhandle tjhnd)
+{
+	void *ftemp = NULL;
+	readyQ.get(&ftemp, true);
+	Frame *f = (Frame *)ftemp;
+	bool draw = false;
+
+	if(f)
+	{
+		draw = f->isXV || f->hdr.flags == RR_EOF;
+		try
+		{
+			if(deadYet || poolError) {}
+			#ifdef USEXV
+			else if(f->isXV)
+			{
+				profBlit.startFrame();
+				((XVFrame *)f)->redraw();
+				profBlit.endFrame(f->hdr.width * f->hdr.height, 0, 1);
+				profTotal.endFrame(f->hdr.width * f->hdr.height, 0, 1);
+				profTotal.startFrame();
+			}
+			#endif
+			else if(draw)
+			{
+				profBlit.startFrame();
+				if(fb->isGL) ((GLFrame *)fb)->init(f->hdr, stereo);
+				else ((FBXFrame *)fb)->init(f->hdr);
+				profBlit.endFrame(drawDamage(), 0, 1);
+				profTotal.endFrame(fb->hdr.framew * fb->hdr.frameh, poolBytes, 1);
+				poolBytes = 0;
+				profTotal.startFrame();
+			}
+			else decompressTile((CompressedFrame *)f, tjhnd);
+		}
+		catch(Error &e)
+		{
+			CriticalSection::SafeLock l(cfmutex);
+			if(!poolError) poolError = e;
+		}
+	}
+
+	CriticalSection::SafeLock l(cfmutex);
+	if(f)
+	{
+		recycle(f);
+		if(draw) busy = false;
+		else inflight--;
+	}
+	nTasks--;
+	if(deadYet) { if(nTasks == 0) tasksDone.signal(); }
+	else pump();
+}
+
+
+// Decompress a tile into the back buffer.  If tjhnd is NULL, then the back
+// buffer's own decompressor instance is used.
+void ClientWin::decompressTile(CompressedFrame *c, tjhandle tjhnd)
+{
+	Timer timer;
+
+	timer.start();
+	if(!tjhnd)
+	{
+		if(fb->isGL) *((GLFrame *)fb) = *c;
+		else *((FBXFrame *)fb) = *c;
+	}
+	else if(fb->isGL) ((GLFrame *)fb)->decompressTile(*c, tjhnd);
+	else ((FBXFrame *)fb)->decompressTile(*c, tjhnd);
+	decompHist.add(timer.elapsed());
+}
+
+
+// Growable string buffer into which writeStats() formats the statistics
+typedef struct
+{
+	char *buf;  size_t len, size;
+} StatsBuf;
+
+
+static void sbprintf(StatsBuf &sb, const char *format, ...)
+{
+	va_list arglist;  int n;
+
+	while(1)
+	{
+		va_start(arglist, format);
+		n = vsnprintf(&sb.buf[sb.len], sb.size - sb.len, format, arglist);
+		va_end(arglist);
+		if(n < 0) THROW("Could not format statistics");
+		if(sb.len + n < sb.size) break;
+		size_t newSize = max(sb.size * 2, sb.len + n + 1);
+		char *newBuf = (char *)realloc(sb.buf, newSize);
+		if(!newBuf) THROW("Memory allocation error");
+		sb.buf = newBuf;  sb.size = newSize;
+	}
+	sb.len += n;
+}
+
+
+static void writeHistogram(StatsBuf &sb, const char *name, Histogram &hist)
+{
+	Histogram h;
+
+	hist.snapshot(h, true);
+	sbprintf(sb,
+		"\"%s\":{\"count\":%lu,\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+		name, h.count(), h.percentile(0.5) * 1000.0,
+		h.percentile(0.99) * 1000.0, h.maximum() * 1000.0);
+}
+
+
+// Write the statistics for all windows to the specified file as a JSON object.
+// Latencies are in milliseconds, and the histograms are reset, so each report
+// covers the period since the previous report.  The report is formatted in
+// memory and written after listMutex is released, so a slow reader cannot
+// stall the creation or deletion of windows.
+void ClientWin::writeStats(FILE *file)
+{
+	StatsBuf sb;
+
+	sb.len = 0;  sb.size = 4096;
+	if((sb.buf = (char *)malloc(sb.size)) == NULL)
+		THROW("Memory allocation error");
+	try
+	{
+		CriticalSection::SafeLock l(listMutex);
+
+		sbprintf(sb, "{\"windows\":[");
+		for(ClientWin *w = first; w; w = w->next)
+		{
+			unsigned long drawn, spoiled;  int queued, decodeQueued;
+
+			w->cfmutex.lock();
+			drawn = w->framesDrawn;  spoiled = w->framesSpoiled;
+			queued = w->q.items() + w->pending.items();
+			decodeQueued = w->tileQ.items() + w->inflight;
+			w->cfmutex.unlock();
+
+			sbprintf(sb, "%s{\"display\":%d,\"window\":\"0x%.8lx\",",
+				w == first ? "" : ",", w->dpynum, (unsigned long)w->window);
+			sbprintf(sb, "\"drawn\":%lu,\"spoiled\":%lu,", drawn, spoiled);
+			sbprintf(sb, "\"queue\":%d,\"decodeQueue\":%d,", queued,
+				decodeQueued);
+			writeHistogram(sb, "receive", w->recvHist);
+			sbprintf(sb, ",");
+			writeHistogram(sb, "decompress", w->decompHist);
+			sbprintf(sb, ",");
+			writeHistogram(sb, "blit", w->blitHist);
+			sbprintf(sb, ",");
+			writeHistogram(sb, "frame", w->frameHist);
+			sbprintf(sb, "}");
+		}
+		sbprintf(sb, "]}\n");
+	}
+	catch(...)
+	{
+		free(sb.buf);  throw;
+	}
+	fwrite(sb.buf, 1, sb.len, file);
+	free(sb.buf);
+}
+
+
+DecodePool::DecodePool(int nthreads_, int wakeFD_) : nthreads(nthreads_),
+	wakeFD(wakeFD_), workers(NULL), threads(NULL)
+{
+	if(nthreads < 1) nthreads = 1;
+	NEWCHECK(workers = new Worker *[nthreads]);
+	NEWCHECK(threads = new Thread *[nthreads]);
+	memset(workers, 0, sizeof(Worker *) * nthreads);
+	memset(threads, 0, sizeof(Thread *) * nthreads);
+	for(int i = 0; i < nthreads; i++)
+	{
+		NEWCHECK(workers[i] = new Worker(this));
+		NEWCHECK(threads[i] = new Thread(workers[i]));
+		threads[i]->start();
+	}
+}
+
+
+// All windows that use the pool must be deleted before the pool.
+DecodePool::~DecodePool(void)
+{
+	q.release();
+	for(int i = 0; i < nthreads; i++)
+	{
+		if(threads[i]) { threads[i]->stop();  delete threads[i]; }
+		delete workers[i];
+	}
+	delete [] threads;  threads = NULL;
+	delete [] workers;  workers = NULL;
+}
+
+
+void DecodePool::wake(void)
+{
+	char c = 0;
+	if(wakeFD >= 0 && write(wakeFD, &c, 1) < 0) {}
+}
+
+
+void DecodePool::Worker::run(void)
+{
+	while(1)
+	{
+		void *w = NULL;
+		parent->q.get(&w);  if(!w) break;
+		((ClientWin *)w)->runTask(tjhnd);
+	}
+}
+
+
+void ClientWin::addDamage(rrframeheader &h)
+{
+	int width = min((int)h.width, (int)h.framew - (int)h.x);
+	int height = min((int)h.height, (int)h.frameh - (int)h.y);
+
+	if(fullDamage || width < 1 || height < 1) return;
+	if(nDamage >= MAXDAMAGE)
+	{
+		fullDamage = true;  nDamage = 0;
+		return;
+	}
+	if(nDamage >= maxDamage)
+	{
+		int newMax = maxDamage ? maxDamage * 2 : 64;
+		Rect *newDamage = (Rect *)realloc(damage, sizeof(Rect) * newMax);
+		if(!newDamage) THROW("Memory allocation error");
+		damage = newDamage;  maxDamage = newMax;
+	}
+	damage[nDamage].x = h.x;  damage[nDamage].y = h.y;
+	damage[nDamage].width = width;  damage[nDamage].height = height;
+	nDamage++;
+}
+
+
+// Sort regions by y, then height, then x
+int ClientWin::compareRows(const void *arg1, const void *arg2)
+{
+	const Rect *r1 = (const Rect *)arg1, *r2 = (const Rect *)arg2;
+
+	if(r1->y != r2->y) return r1->y - r2->y;
+	if(r1->height != r2->height) return r1->height - r2->height;
+	return r1->x - r2->x;
+}
+
+
+// Sort regions by x, then width, then y
+int ClientWin::compareColumns(const void *arg1, const void *arg2)
+{
+	const Rect *r1 = (const Rect *)arg1, *r2 = (const Rect *)arg2;
+
+	if(r1->x != r2->x) return r1->x - r2->x;
+	if(r1->width != r2->width) return r1->width - r2->width;
+	return r1->y - r2->y;
+}
+
+
+// Merge horizontally adjacent damaged regions of the same height, then
+// vertically adjacent damaged regions of the same width (the regions are
+// usually tiles, so this produces a few large rectangles), discarding
+// duplicates.
+void ClientWin::mergeDamage(void)
+{
+	for(int pass = 0; pass < 2 && nDamage > 1; pass++)
+	{
+		int i, j;
+		qsort(damage, nDamage, sizeof(Rect), pass ? compareColumns : compareRows);
+		for(i = 1, j = 0; i < nDamage; i++)
+		{
+			Rect *prev = &damage[j], *cur = &damage[i];
+
+			if(cur->x == prev->x && cur->y == prev->y && cur->width == prev->width
+				&& cur->height == prev->height)
+				continue;
+			if(!pass && cur->y == prev->y && cur->height == prev->height
+				&& cur->x <= prev->x + prev->width)
+				prev->width = max(prev->width, cur->x + cur->width - prev->x);
+			else if(pass && cur->x == prev->x && cur->width == prev->width
+				&& cur->y <= prev->y + prev->height)
+				prev->height = max(prev->height, cur->y + cur->height - prev->y);
+			else if(++j != i) damage[j] = *cur;
+		}
+		nDamage = j + 1;
+	}
+}
+
+
+// Draw the regions of the back buffer that have changed since the last frame
+// was drawn, and return the number of pixels drawn.
+long ClientWin::drawDamage(void)
+{
+	long pixels = (long)fb->hdr.framew * (long)fb->hdr.frameh, area = 0;
+	int i;
+
+	if(fb->isGL)
+	{
+		// GLFrame uploads only the damaged regions to its texture, but the back
+		// buffer is undefined after a swap, so the whole frame is drawn.
+		((GLFrame *)fb)->redraw();
+		nDamage = 0;  fullDamage = false;
+		return pixels;
+	}
+
+	FBXFrame *fbx = (FBXFrame *)fb;
+	if(fb->hdr.framew != damageWidth || fb->hdr.frameh != damageHeight)
+	{
+		fullDamage = true;
+		damageWidth = fb->hdr.framew;  damageHeight = fb->hdr.frameh;
+	}
+	if(fbx->exposed()) fullDamage = true;
+	if(!fullDamage && nDamage > 0)
+	{
+		mergeDamage();
+		for(i = 0; i < nDamage; i++)
+			area += (long)damage[i].width * (long)damage[i].height;
+		// If most of the frame has changed, then a single blit is cheaper.
+		if(area > pixels / 2) fullDamage = true;
+	}
+	if(fullDamage) fbx->redraw();
+	else if(nDamage > 0)
+	{
+		for(i = 0; i < nDamage; i++)
+			fbx->drawTile(damage[i].x, damage[i].y, damage[i].width,
+				damage[i].height);
+		fbx->sync();
+		pixels = area;
+	}
+	else pixels = 0;
+	nDamage = 0;  fullDamage = false;
+	return pixels;
+}
@@ -18,6 +18,8 @@
 #include "Frame.h"
 #include "Thread.h"
 #include "GenericQ.h"
+#include "Profiler.h"
+#include <stdio.h>
 
 
 enum { RR_DRAWAUTO = -1, RR_DRAWX11 = 0, RR_DRAWOGL };
@@ -25,28 +27,98 @@ enum { RR_DRAWAUTO = -1, RR_DRAWX11 = 0, RR_DRAWOGL };
 
 namespace vglclient
 {
+	class ClientWin;
+
+	// A fixed-size pool of threads that decompresses and draws the frames for
+	// any number of windows (see VGLCLIENT_MULTIPLEX.)  Each item in the queue is
+	// a window that has one task pending (see ClientWin::runTask().)  wakeFD, if
+	// not -1, is written to whenever a receive buffer is returned to a window
+	// that ran out of them, so that the thread receiving data for that window
+	// can resume.
+	class DecodePool
+	{
+		public:
+
+			DecodePool(int nthreads, int wakeFD);
+			~DecodePool(void);
+			void add(ClientWin *w) { q.add(w); }
+			void wake(void);
+
+		private:
+
+			class Worker;
+			int nthreads, wakeFD;
+			Worker **workers;  vglutil::Thread **threads;
+			vglutil::GenericQ q;
+
+		class Worker : public vglutil::Runnable
+		{
+			public:
+
+				Worker(DecodePool *parent_) : tjhnd(NULL), parent(parent_)
+				{
+					if(!(tjhnd = tjInitDecompress())) THROW(tjGetErrorStr());
+				}
+
+				virtual ~Worker(void)
+				{
+					if(tjhnd) tjDestroy(tjhnd);
+				}
+
+				void run(void);
+
+			private:
+
+				tjhandle tjhnd;
+				DecodePool *parent;
+		};
+	};
+
 	class ClientWin : public vglutil::Runnable
 	{
 		public:
 
-			ClientWin(int dpynum, Window window, int drawMethod, bool stereo);
+			ClientWin(int dpynum, Window window, int drawMethod, int nprocs,
+				int nbufs, bool stereo, DecodePool *pool = NULL);
 			virtual ~ClientWin(void);
-			vglcommon::Frame *getFrame(bool useXV);
+			vglcommon::Frame *getFrame(bool useXV, bool wait = true);
 			void drawFrame(vglcommon::Frame *f);
 			int match(int dpynum, Window window);
 			bool isStereo(void) { return stereo; }
+			void runTask(tjhandle tjhnd);
+			static void writeStats(FILE *file);
 
 		private:
 
 			void initGL(void);
 			void initX11(void);
+			bool stereoChanged(vglcommon::CompressedFrame *c);
+			void checkStereo(vglcommon::CompressedFrame *c);
+			bool fbChanged(vglcommon::CompressedFrame *c);
+			void initFB(vglcommon::CompressedFrame *c);
+			void startDecompressors(void);
+			void joinDecompressors(void);
+			void recycle(vglcommon::Frame *f);
+			void addDamage(rrframeheader &h);
+			void mergeDamage(void);
+			long drawDamage(void);
+			void decompressTile(vglcommon::CompressedFrame *c, tjhandle tjhnd);
 
 			int drawMethod, reqDrawMethod;
 			static const int NFRAMES = 2;
 			vglcommon::Frame *fb;
-			vglcommon::CompressedFrame cframes[NFRAMES];  int cfindex;
+			// Tiles are received into a pool of compressed frames, which are returned
+			// to the pool once the tiles have been decompressed.  Thus, the listener
+			// thread blocks only if all of the buffers in the pool are waiting to be
+			// decompressed.  The buffers grow as needed to accommodate the tiles
+			// received into them, so they are not reallocated once the pool has
+			// warmed up.  Tiles that are received in framed batches are decompressed
+			// directly from the batch buffers (see
+			// CompressedFrame::initExternal()), so those tiles are not copied.
+			vglcommon::CompressedFrame *cframes;  int nCFrames;
+			vglutil::GenericQ cfPool;
 			#ifdef USEXV
-			vglcommon::XVFrame *xvframes[NFRAMES];
+			vglcommon::XVFrame *xvframes[NFRAMES];  int xvindex;
 			#endif
 			vglutil::GenericQ q;
 			bool deadYet;
@@ -54,8 +126,99 @@ namespace vglclient
 			void run(void);
 			vglutil::Thread *thread;
 			vglutil::CriticalSection cfmutex;
+			// Number of complete frames (end-of-frame markers) in q.  If a newer
+			// complete frame is already waiting when a frame is finished, then the
+			// frame is not drawn (spoiled.)  Its tiles are still decompressed, since
+			// the newer frame contains only the tiles that changed.
+			int pendingFrames;  bool spoil;
 			bool stereo;
 			vglutil::CriticalSection mutex;
+
+			// The window thread records the region covered by each tile that it
+			// receives, so that only the regions of the back buffer that have
+			// changed since the last frame was drawn are drawn to the window.  The
+			// damage from spoiled frames is carried over to the next frame that is
+			// drawn.  The whole frame is drawn if the back buffer or the frame
+			// geometry changes, if the window is exposed, or if too many regions
+			// have accumulated.
+			typedef struct { int x, y, width, height; } Rect;
+			static const int MAXDAMAGE = 4096;
+			Rect *damage;  int nDamage, maxDamage;  bool fullDamage;
+			int damageWidth, damageHeight;
+			static int compareRows(const void *arg1, const void *arg2);
+			static int compareColumns(const void *arg1, const void *arg2);
+
+			// The tiles in a frame are decompressed concurrently into the back
+			// buffer (fb) by a pool of decompression threads, which pull tiles from
+			// a shared queue.  The window thread initializes the back buffer before
+			// dispatching the first tile in a frame, and it waits for all of the
+			// tiles to be decompressed (by waiting on tileDone once per dispatched
+			// tile) before drawing the frame or reinitializing the back buffer.
+			class Decompressor;
+			int nprocs, nDispatched;
+			Decompressor **decomp;  vglutil::Thread **dthread;
+			vglutil::GenericQ tileQ;
+			vglutil::Semaphore tileDone;
+			rrframeheader fbhdr;  bool fbValid;
+
+			// If a shared DecodePool is specified, then this window has no threads
+			// of its own.  The receiving thread passes frames to submit() without
+			// blocking, and they are held in pending until they can be processed
+			// in order.  pump() dispatches each tile to the pool as a separate
+			// task, so the tiles in a frame are decompressed concurrently, but the
+			// back buffer is not reinitialized or drawn (which is also done by the
+			// pool) until all of the tiles that were dispatched before it have been
+			// decompressed.  The pool state is protected by cfmutex.
+			void submit(vglcommon::Frame *f);
+			void pump(void);
+			void dispatch(vglcommon::Frame *f);
+			void checkPoolError(void);
+			DecodePool *pool;
+			vglutil::GenericQ pending, readyQ;
+			vglcommon::Frame *held;
+			int inflight, nTasks;
+			bool busy, stalled;
+			vglutil::Error poolError;
+			vglutil::Event tasksDone;
+			long poolBytes;
+			vglcommon::Profiler profTotal, profBlit;
+
+			// Latency statistics, which are reported by writeStats() (see
+			// VGLCLIENT_STATS.)  recvHist records the time from the first tile of a
+			// frame being received to the end-of-frame marker being received,
+			// decompHist records the time taken to decompress each tile, blitHist
+			// records the time taken to draw each frame, and frameHist records the
+			// time between successive frames.  Every window is placed in a list, so
+			// that all of them can be reported.  The list is protected by
+			// listMutex.
+			vglcommon::Histogram recvHist, decompHist, blitHist, frameHist;
+			double recvStart;
+			unsigned long framesDrawn, framesSpoiled;
+			ClientWin *prev, *next;
+			static ClientWin *first;
+			static vglutil::CriticalSection listMutex;
+
+		class Decompressor : public vglutil::Runnable
+		{
+			public:
+
+				Decompressor(ClientWin *parent_) : tjhnd(NULL), parent(parent_)
+				{
+					if(!(tjhnd = tjInitDecompress())) THROW(tjGetErrorStr());
+				}
+
+				virtual ~Decompressor(void)
+				{
+					if(tjhnd) tjDestroy(tjhnd);
+				}
+
+				void run(void);
+
+			private:
+
+				tjhandle tjhnd;
+				ClientWin *parent;
+		};
 	};
 }
 
@@ -13,6 +13,7 @@
 
 // Frame drawn using OpenGL
 
+#define GL_GLEXT_PROTOTYPES
 #include "GLFrame.h"
 #include "Error.h"
 #include "Log.h"
@@ -29,8 +30,29 @@ static int tjpf[PIXELFORMATS] =
 };
 
 
+// Converts full-range (JFIF) YCbCr to RGB.  The texture coordinates address
+// the luminance plane, and chromaScale maps them to the chrominance planes,
+// which are half the width and height of the luminance plane (rounded up.)
+static const char *yuvShaderSource =
+	"uniform sampler2D yTex, uTex, vTex;\n"
+	"uniform vec2 chromaScale;\n"
+	"void main(void)\n"
+	"{\n"
+	"	vec2 c = gl_TexCoord[0].st * chromaScale;\n"
+	"	float y = texture2D(yTex, gl_TexCoord[0].st).r;\n"
+	"	float cb = texture2D(uTex, c).r - 128.0 / 255.0;\n"
+	"	float cr = texture2D(vTex, c).r - 128.0 / 255.0;\n"
+	"	gl_FragColor = vec4(y + 1.402 * cr, y - 0.344136 * cb - 0.714136 * cr,\n"
+	"		y + 1.772 * cb, 1.0);\n"
+	"}\n";
+
+
 GLFrame::GLFrame(char *dpystring, Window win_) : Frame(), dpy(NULL), win(win_),
-	ctx(0), tjhnd(NULL), newdpy(false)
+	ctx(0), tjhnd(NULL), newdpy(false), useTexture(true), textureInit(false),
+	pboIndex(0), texWidth(0), texHeight(0), dirty(NULL), nDirty(0),
+	maxDirty(0), nYUVDirty(0), allDirty(true), useYUV(false), yuvActive(false),
+	yuvInit(false), bitsStale(false), yuvBuf(NULL), yuvWidth(0), yuvHeight(0),
+	fbo(0), program(0)
 {
 	if(!dpystring || !win)
 		throw(Error("GLFrame::GLFrame", "Invalid argument"));
@@ -43,7 +65,11 @@ GLFrame::GLFrame(char *dpystring, Window win_) : Frame(), dpy(NULL), win(win_),
 
 
 GLFrame::GLFrame(Display *dpy_, Window win_) : Frame(), dpy(NULL), win(win_),
-	ctx(0), tjhnd(NULL), newdpy(false)
+	ctx(0), tjhnd(NULL), newdpy(false), useTexture(true), textureInit(false),
+	pboIndex(0), texWidth(0), texHeight(0), dirty(NULL), nDirty(0),
+	maxDirty(0), nYUVDirty(0), allDirty(true), useYUV(false), yuvActive(false),
+	yuvInit(false), bitsStale(false), yuvBuf(NULL), yuvWidth(0), yuvHeight(0),
+	fbo(0), program(0)
 {
 	if(!dpy_ || !win_) throw(Error("GLFrame::GLFrame", "Invalid argument"));
 
@@ -56,6 +82,17 @@ GLFrame::GLFrame(Display *dpy_, Window win_) : Frame(), dpy(NULL), win(win_),
 void GLFrame::init(void)
 {
 	XVisualInfo *v = NULL;
+	char *env = NULL;
+
+	memset(tex, 0, sizeof(tex));
+	memset(pbo, 0, sizeof(pbo));
+	memset(planes, 0, sizeof(planes));
+	memset(strides, 0, sizeof(strides));
+	memset(yuvTex, 0, sizeof(yuvTex));
+	if((env = getenv("VGLCLIENT_GLTEXTURE")) != NULL && !strncmp(env, "0", 1))
+		useTexture = false;
+	if((env = getenv("VGLCLIENT_YUVDECODE")) != NULL && !strncmp(env, "1", 1))
+		useYUV = true;
 
 	try
 	{
@@ -96,6 +133,17 @@ GLFrame::~GLFrame(void)
 {
 	if(ctx && dpy)
 	{
+		if(textureInit && glXMakeCurrent(dpy, win, ctx))
+		{
+			glDeleteTextures(2, tex);
+			glDeleteBuffers(NPBOS, pbo);
+			if(yuvInit)
+			{
+				glDeleteTextures(3, yuvTex);
+				glDeleteFramebuffers(1, &fbo);
+				glDeleteProgram(program);
+			}
+		}
 		glXMakeCurrent(dpy, 0, 0);  glXDestroyContext(dpy, ctx);  ctx = 0;
 	}
 	if(dpy && newdpy)
@@ -107,6 +155,8 @@ GLFrame::~GLFrame(void)
 		tjDestroy(tjhnd);  tjhnd = NULL;
 	}
 	delete [] rbits;  rbits = NULL;
+	free(dirty);  dirty = NULL;
+	free(yuvBuf);  yuvBuf = NULL;
 }
 
 
@@ -114,16 +164,54 @@ void GLFrame::init(rrframeheader &h, bool stereo_)
 {
 	int format = PF_RGB;
 	if(LittleEndian() && h.compress != RRCOMP_RGB) format = PF_BGR;
+	bool resized = h.framew != hdr.framew || h.frameh != hdr.frameh;
 	Frame::init(h, format, FRAME_BOTTOMUP, stereo_);
+
+	if(resized)
+	{
+		// Frame::init() discards the pixels if the frame size changes, so the
+		// whole frame will be uploaded on the next redraw.  Any dirty regions
+		// that were recorded for the previous size are no longer valid.
+		CriticalSection::SafeLock l(dirtyMutex);
+		nDirty = nYUVDirty = 0;  allDirty = true;  bitsStale = false;
+	}
+	yuvActive = useYUV && useTexture && !stereo;
+	if(yuvActive && (yuvWidth != hdr.framew || yuvHeight != hdr.frameh))
+	{
+		int cw = (hdr.framew + 1) / 2, ch = (hdr.frameh + 1) / 2;
+		unsigned char *newBuf = (unsigned char *)realloc(yuvBuf,
+			(size_t)hdr.framew * hdr.frameh + (size_t)cw * ch * 2);
+		if(!newBuf) THROW("Memory allocation error");
+		yuvBuf = newBuf;
+		planes[0] = yuvBuf;  strides[0] = hdr.framew;
+		planes[1] = &planes[0][hdr.framew * hdr.frameh];  strides[1] = cw;
+		planes[2] = &planes[1][cw * ch];  strides[2] = cw;
+		yuvWidth = hdr.framew;  yuvHeight = hdr.frameh;
+	}
 }
 
 
 GLFrame &GLFrame::operator= (CompressedFrame &cf)
+{
+	if(!cf.bits || cf.hdr.size < 1) THROW("JPEG not initialized");
+	init(cf.hdr, cf.stereo);
+	if(cf.hdr.compress != RRCOMP_RGB && !tjhnd)
+	{
+		if((tjhnd = tjInitDecompress()) == NULL)
+			throw(Error("GLFrame::decompressor", tjGetErrorStr()));
+	}
+	decompressTile(cf, tjhnd);
+	return *this;
+}
+
+
+// Decompress a tile into this frame without reinitializing the frame (see
+// FBXFrame::decompressTile().)
+void GLFrame::decompressTile(CompressedFrame &cf, tjhandle tjhnd)
 {
 	int tjflags = TJ_BOTTOMUP;
 
 	if(!cf.bits || cf.hdr.size < 1) THROW("JPEG not initialized");
-	init(cf.hdr, cf.stereo);
 	if(!bits) THROW("Frame not initialized");
 	int width = min(cf.hdr.width, hdr.framew - cf.hdr.x);
 	int height = min(cf.hdr.height, hdr.frameh - cf.hdr.y);
@@ -138,10 +226,31 @@ GLFrame &GLFrame::operator= (CompressedFrame &cf)
 		}
 		else
 		{
-			if(!tjhnd)
+			if(!tjhnd) THROW("Invalid argument");
+			if(yuvActive && !(cf.hdr.x & 1) && !(cf.hdr.y & 1))
 			{
-				if((tjhnd = tjInitDecompress()) == NULL)
-					throw(Error("GLFrame::decompressor", tjGetErrorStr()));
+				// Decompress 4:2:0 tiles into the YUV planes, leaving the color
+				// conversion to redrawTexture().  Other tiles (including tiles that
+				// don't start on a chrominance sample boundary) are decompressed into
+				// the frame as usual.
+				int jpegWidth = 0, jpegHeight = 0, jpegSubsamp = -1,
+					jpegColorspace = -1;
+				TRY_TJ(tjDecompressHeader3(tjhnd, cf.bits, cf.hdr.size, &jpegWidth,
+					&jpegHeight, &jpegSubsamp, &jpegColorspace));
+				if(jpegSubsamp == TJSAMP_420 && jpegWidth == width
+					&& jpegHeight == height)
+				{
+					unsigned char *dstPlanes[3] =
+					{
+						&planes[0][strides[0] * cf.hdr.y + cf.hdr.x],
+						&planes[1][strides[1] * (cf.hdr.y / 2) + cf.hdr.x / 2],
+						&planes[2][strides[2] * (cf.hdr.y / 2) + cf.hdr.x / 2]
+					};
+					TRY_TJ(tjDecompressToYUVPlanes(tjhnd, cf.bits, cf.hdr.size,
+						dstPlanes, width, strides, height, 0));
+					addDirty(cf.hdr.x, cf.hdr.y, width, height, true);
+					return;
+				}
 			}
 			int y = max(0, hdr.frameh - cf.hdr.y - height);
 			TRY_TJ(tjDecompress2(tjhnd, cf.bits, cf.hdr.size,
@@ -154,18 +263,458 @@ GLFrame &GLFrame::operator= (CompressedFrame &cf)
 					tjpf[pf->id], tjflags));
 			}
 		}
+		if(useTexture) addDirty(cf.hdr.x, cf.hdr.y, width, height);
 	}
-	return *this;
+}
+
+
+// Record a region of the frame (specified in top-down coordinates) that has
+// changed since the last redraw.  If yuv is true, then the region was
+// decompressed into the YUV planes rather than into the frame.
+void GLFrame::addDirty(int x, int y, int width, int height, bool yuv)
+{
+	CriticalSection::SafeLock l(dirtyMutex);
+
+	// In YUV mode, all regions are recorded so that they can be applied in
+	// order.
+	if(allDirty && !yuvActive) return;
+	if(nDirty >= MAXDIRTY)
+	{
+		// Too many regions (for instance, if several frames in a row were
+		// spoiled) -- just upload the whole frame.  That isn't possible if the
+		// frame doesn't contain the most recent pixels, so in that case, discard
+		// the regions that have been superseded.
+		if(!bitsStale && nYUVDirty == 0 && !yuv)
+		{
+			allDirty = true;  nDirty = 0;
+			if(!yuvActive) return;
+		}
+		else if(nDirty >= maxDirty) compactDirty();
+	}
+	if(nDirty >= maxDirty)
+	{
+		int newMax = maxDirty ? maxDirty * 2 : 64;
+		Rect *newDirty = (Rect *)realloc(dirty, sizeof(Rect) * newMax);
+		if(!newDirty) THROW("Memory allocation error");
+		dirty = newDirty;  maxDirty = newMax;
+	}
+	dirty[nDirty].x = x;  dirty[nDirty].y = y;
+	dirty[nDirty].width = width;  dirty[nDirty].height = height;
+	dirty[nDirty].yuv = yuv;
+	if(yuv) nYUVDirty++;
+	nDirty++;
+}
+
+
+// Remove each dirty region that has been superseded by a later region with the
+// same geometry.  The regions are usually tiles, so this leaves at most one
+// region per tile.  dirtyMutex must be locked.
+void GLFrame::compactDirty(void)
+{
+	int i, j, n = 0;
+
+	nYUVDirty = 0;
+	for(i = 0; i < nDirty; i++)
+	{
+		Rect r = dirty[i];
+		for(j = i + 1; j < nDirty; j++)
+		{
+			if(dirty[j].x == r.x && dirty[j].y == r.y && dirty[j].width == r.width
+				&& dirty[j].height == r.height)
+				break;
+		}
+		if(j < nDirty) continue;
+		dirty[n++] = r;
+		if(r.yuv) nYUVDirty++;
+	}
+	nDirty = n;
 }
 
 
 void GLFrame::redraw(void)
 {
+	if(useTexture)
+	{
+		if(!glXMakeCurrent(dpy, win, ctx))
+			THROW("Could not bind OpenGL context to window (window may have disappeared)");
+		if(initTexture())
+		{
+			redrawTexture();
+			sync();
+			return;
+		}
+	}
+	if(useYUV) disableYUV();
 	drawTile(0, 0, hdr.framew, hdr.frameh);
 	sync();
 }
 
 
+// Create the textures and pixel unpack buffers used in texture mode.  Returns
+// false (and disables texture mode) if the OpenGL implementation does not
+// support non-power-of-two textures and pixel buffer objects.  The OpenGL
+// context must be current.
+bool GLFrame::initTexture(void)
+{
+	if(textureInit) return true;
+
+	int major = 0, minor = 0;
+	const char *version = (const char *)glGetString(GL_VERSION);
+	if(!version || sscanf(version, "%d.%d", &major, &minor) < 2
+		|| major < 2 || (major == 2 && minor < 1))
+	{
+		vglout.println("[VGL] OpenGL %s does not support textured drawing.",
+			version ? version : "(unknown version)");
+		vglout.println("[VGL]    Falling back to glDrawPixels().");
+		useTexture = false;
+		return false;
+	}
+	glGenTextures(2, tex);
+	glGenBuffers(NPBOS, pbo);
+	for(int i = 0; i < 2; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, tex[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if(glError()) THROW("Could not initialize textures");
+	textureInit = true;
+	if(useYUV && !initYUV()) disableYUV();
+	return true;
+}
+
+
+// Create the shader program, textures, and framebuffer object used in YUV
+// mode.  Returns false if the OpenGL implementation does not support them.
+// The OpenGL context must be current.
+bool GLFrame::initYUV(void)
+{
+	int major = 0, minor = 0;
+	const char *version = (const char *)glGetString(GL_VERSION);
+	if(!version || sscanf(version, "%d.%d", &major, &minor) < 2 || major < 3)
+	{
+		vglout.println("[VGL] OpenGL %s does not support YUV decoding.",
+			version ? version : "(unknown version)");
+		vglout.println("[VGL]    Decoding all tiles to RGB.");
+		return false;
+	}
+
+	GLint status = GL_FALSE;
+	GLuint shader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(shader, 1, &yuvShaderSource, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if(status == GL_TRUE)
+	{
+		program = glCreateProgram();
+		glAttachShader(program, shader);
+		glLinkProgram(program);
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+	}
+	glDeleteShader(shader);
+	if(status != GL_TRUE)
+	{
+		if(program) { glDeleteProgram(program);  program = 0; }
+		glError();
+		vglout.println("[VGL] Could not build YUV conversion shader.  Decoding all tiles to RGB.");
+		return false;
+	}
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "yTex"), 0);
+	glUniform1i(glGetUniformLocation(program, "uTex"), 1);
+	glUniform1i(glGetUniformLocation(program, "vTex"), 2);
+	glUseProgram(0);
+
+	glGenTextures(3, yuvTex);
+	for(int i = 0; i < 3; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, yuvTex[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glGenFramebuffers(1, &fbo);
+	if(glError()) THROW("Could not initialize YUV decoding");
+	yuvInit = true;
+	return true;
+}
+
+
+// Disable YUV mode if the OpenGL implementation does not support it.  The
+// regions that were decompressed into the YUV planes are converted to RGB and
+// stored in the frame.  This happens before the first redraw, so the frame
+// contains all of the other pixels.
+void GLFrame::disableYUV(void)
+{
+	CriticalSection::SafeLock l(dirtyMutex);
+
+	useYUV = yuvActive = false;
+	if(nYUVDirty < 1) return;
+	if(!tjhnd && (tjhnd = tjInitDecompress()) == NULL)
+		throw(Error("GLFrame::decompressor", tjGetErrorStr()));
+
+	// A region must not overwrite a later region that was decompressed into the
+	// frame.
+	compactDirty();
+	for(int i = 0; i < nDirty; i++)
+	{
+		Rect &r = dirty[i];
+		if(!r.yuv) continue;
+		const unsigned char *srcPlanes[3] =
+		{
+			&planes[0][strides[0] * r.y + r.x],
+			&planes[1][strides[1] * (r.y / 2) + r.x / 2],
+			&planes[2][strides[2] * (r.y / 2) + r.x / 2]
+		};
+		TRY_TJ(tjDecodeYUVPlanes(tjhnd, srcPlanes, strides, TJSAMP_420,
+			&bits[pitch * (hdr.frameh - r.y - r.height) + r.x * pf->size],
+			r.width, pitch, r.height, tjpf[pf->id], TJFLAG_BOTTOMUP));
+		r.yuv = false;
+	}
+	nYUVDirty = 0;
+}
+
+
+// Convert the YUV regions dirty[first] through dirty[last - 1], which have
+// already been uploaded to the YUV textures, to RGB and render them into the
+// left eye texture.  dirtyMutex must be locked.
+void GLFrame::drawYUV(int first, int last)
+{
+	float w = (float)hdr.framew, h = (float)hdr.frameh;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, hdr.framew, hdr.frameh);
+	glUseProgram(program);
+	for(int i = 0; i < 3; i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, yuvTex[i]);
+	}
+	// The YUV planes are top-down, whereas the texture is bottom-up.
+	glBegin(GL_QUADS);
+	for(int i = first; i < last; i++)
+	{
+		float s0 = (float)dirty[i].x / w;
+		float s1 = (float)(dirty[i].x + dirty[i].width) / w;
+		float t0 = (float)dirty[i].y / h;
+		float t1 = (float)(dirty[i].y + dirty[i].height) / h;
+		glTexCoord2f(s0, t1);  glVertex2f(s0 * 2.0f - 1.0f, 1.0f - t1 * 2.0f);
+		glTexCoord2f(s1, t1);  glVertex2f(s1 * 2.0f - 1.0f, 1.0f - t1 * 2.0f);
+		glTexCoord2f(s1, t0);  glVertex2f(s1 * 2.0f - 1.0f, 1.0f - t0 * 2.0f);
+		glTexCoord2f(s0, t0);  glVertex2f(s0 * 2.0f - 1.0f, 1.0f - t0 * 2.0f);
+	}
+	glEnd();
+	for(int i = 2; i >= 0; i--)
+	{
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	glUseProgram(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	bitsStale = true;
+}
+
+
+void GLFrame::redrawTexture(void)
+{
+	int glFormat = (pf->id == PF_BGR ? GL_BGR : GL_RGB);
+	int neyes = (stereo && rbits) ? 2 : 1, i, e;
+
+	e = glGetError();
+	while(e != GL_NO_ERROR) e = glGetError();  // Clear previous error
+
+	CriticalSection::SafeLock l(dirtyMutex);
+
+	if(texWidth != hdr.framew || texHeight != hdr.frameh)
+	{
+		for(i = 0; i < 2; i++)
+		{
+			glBindTexture(GL_TEXTURE_2D, tex[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, hdr.framew, hdr.frameh, 0,
+				glFormat, GL_UNSIGNED_BYTE, NULL);
+		}
+		if(yuvInit)
+		{
+			int cw = (hdr.framew + 1) / 2, ch = (hdr.frameh + 1) / 2;
+			for(i = 0; i < 3; i++)
+			{
+				glBindTexture(GL_TEXTURE_2D, yuvTex[i]);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8, i ? cw : hdr.framew,
+					i ? ch : hdr.frameh, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+			}
+			glUseProgram(program);
+			glUniform2f(glGetUniformLocation(program, "chromaScale"),
+				(float)hdr.framew / (float)(cw * 2),
+				(float)hdr.frameh / (float)(ch * 2));
+			glUseProgram(0);
+			glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+				GL_TEXTURE_2D, tex[0], 0);
+			e = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			if(e != GL_FRAMEBUFFER_COMPLETE)
+				THROW("Could not attach texture to framebuffer object");
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		texWidth = hdr.framew;  texHeight = hdr.frameh;
+		allDirty = true;
+	}
+
+	// If most of the frame has changed, then a single upload is cheaper than
+	// many small ones.  That isn't possible if the frame doesn't contain the
+	// most recent pixels.
+	if(!allDirty && !bitsStale && nYUVDirty == 0)
+	{
+		long area = 0;
+		for(i = 0; i < nDirty; i++)
+			area += (long)dirty[i].width * dirty[i].height;
+		if(area > (long)hdr.framew * hdr.frameh / 2) allDirty = true;
+	}
+
+	// If the whole frame is uploaded, then the dirty regions are still applied
+	// afterwards if any of them were decompressed into the YUV planes.
+	Rect full = { 0, 0, hdr.framew, hdr.frameh, false };
+	int nRects = (allDirty && nYUVDirty == 0) ? 0 : nDirty;
+
+	if(allDirty || nRects > 0)
+	{
+		// Pack the pixels for each region (from each eye, or from each YUV plane)
+		// into the next pixel unpack buffer, in the order in which the regions
+		// will be applied.  Orphaning the buffer's previous storage allows the
+		// driver to keep using it for a transfer that is still in progress.
+		long size = 0;
+		for(i = allDirty ? -1 : 0; i < nRects; i++)
+		{
+			Rect &r = i < 0 ? full : dirty[i];
+			if(r.yuv)
+				size += (long)r.width * r.height + (long)((r.width + 1) / 2)
+					* ((r.height + 1) / 2) * 2;
+			else size += (long)r.width * r.height * pf->size * neyes;
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[pboIndex]);
+		pboIndex = (pboIndex + 1) % NPBOS;
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		unsigned char *ptr =
+			(unsigned char *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if(!ptr)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			THROW("Could not map pixel unpack buffer");
+		}
+		for(i = allDirty ? -1 : 0; i < nRects; i++)
+		{
+			Rect &r = i < 0 ? full : dirty[i];
+			if(r.yuv)
+			{
+				for(int p = 0; p < 3; p++)
+				{
+					int px = p ? r.x / 2 : r.x, py = p ? r.y / 2 : r.y;
+					int pw = p ? (r.width + 1) / 2 : r.width;
+					int ph = p ? (r.height + 1) / 2 : r.height;
+					unsigned char *src = &planes[p][strides[p] * py + px];
+					for(int j = 0; j < ph; j++)
+					{
+						memcpy(ptr, src, pw);
+						ptr += pw;  src += strides[p];
+					}
+				}
+				continue;
+			}
+			for(int eye = 0; eye < neyes; eye++)
+			{
+				int y = hdr.frameh - r.y - r.height;
+				int rowSize = r.width * pf->size;
+				unsigned char *src =
+					&(eye ? rbits : bits)[pitch * y + r.x * pf->size];
+				for(int j = 0; j < r.height; j++)
+				{
+					memcpy(ptr, src, rowSize);
+					ptr += rowSize;  src += pitch;
+				}
+			}
+		}
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		// Upload the regions.  Each run of consecutive YUV regions is uploaded to
+		// the YUV textures and then converted into the left eye texture before
+		// the next RGB region is uploaded.
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		long offset = 0;  int first = -1;
+		for(i = allDirty ? -1 : 0; i < nRects; i++)
+		{
+			Rect &r = i < 0 ? full : dirty[i];
+			if(r.yuv)
+			{
+				for(int p = 0; p < 3; p++)
+				{
+					int pw = p ? (r.width + 1) / 2 : r.width;
+					int ph = p ? (r.height + 1) / 2 : r.height;
+					glBindTexture(GL_TEXTURE_2D, yuvTex[p]);
+					glTexSubImage2D(GL_TEXTURE_2D, 0, p ? r.x / 2 : r.x,
+						p ? r.y / 2 : r.y, pw, ph, GL_LUMINANCE, GL_UNSIGNED_BYTE,
+						(GLvoid *)offset);
+					offset += (long)pw * ph;
+				}
+				if(first < 0) first = i;
+				continue;
+			}
+			if(first >= 0) { drawYUV(first, i);  first = -1; }
+			for(int eye = 0; eye < neyes; eye++)
+			{
+				glBindTexture(GL_TEXTURE_2D, tex[eye]);
+				glTexSubImage2D(GL_TEXTURE_2D, 0, r.x,
+					hdr.frameh - r.y - r.height, r.width, r.height, glFormat,
+					GL_UNSIGNED_BYTE, (GLvoid *)offset);
+				offset += (long)r.width * r.height * pf->size;
+			}
+		}
+		if(first >= 0) drawYUV(first, nRects);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	nDirty = nYUVDirty = 0;  allDirty = false;
+
+	// If YUV mode is no longer active (because the frame is now stereo), then
+	// the frame must once again contain all of the pixels.
+	if(bitsStale && !yuvActive)
+	{
+		glBindTexture(GL_TEXTURE_2D, tex[0]);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_2D, 0, glFormat, GL_UNSIGNED_BYTE, bits);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		bitsStale = false;
+	}
+
+	int oldbuf = -1;
+	glGetIntegerv(GL_DRAW_BUFFER, &oldbuf);
+	glViewport(0, 0, hdr.framew, hdr.frameh);
+	glEnable(GL_TEXTURE_2D);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	for(int eye = 0; eye < neyes; eye++)
+	{
+		if(stereo) glDrawBuffer(eye ? GL_BACK_RIGHT : GL_BACK_LEFT);
+		glBindTexture(GL_TEXTURE_2D, tex[eye]);
+		glBegin(GL_QUADS);
+		glTexCoord2f(0.0f, 0.0f);  glVertex2f(-1.0f, -1.0f);
+		glTexCoord2f(1.0f, 0.0f);  glVertex2f(1.0f, -1.0f);
+		glTexCoord2f(1.0f, 1.0f);  glVertex2f(1.0f, 1.0f);
+		glTexCoord2f(0.0f, 1.0f);  glVertex2f(-1.0f, 1.0f);
+		glEnd();
+	}
+	if(stereo) glDrawBuffer(oldbuf);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDisable(GL_TEXTURE_2D);
+
+	if(glError()) THROW("Could not draw texture");
+}
+
+
 void GLFrame::drawTile(int x, int y, int width, int height)
 {
 	if(x < 0 || width < 1 || (x + width) > hdr.framew || y < 0 || height < 1
@@ -31,6 +31,7 @@ namespace vglcommon
 			~GLFrame(void);
 			void init(rrframeheader &h, bool stereo);
 			GLFrame &operator= (CompressedFrame &cf);
+			void decompressTile(CompressedFrame &cf, tjhandle tjhnd);
 			void redraw(void);
 			void drawTile(int x, int y, int width, int height);
 			void sync(void);
@@ -39,11 +40,54 @@ namespace vglcommon
 
 			void init(void);
 			int glError(void);
+			void addDirty(int x, int y, int width, int height, bool yuv = false);
+			void compactDirty(void);
+			bool initTexture(void);
+			bool initYUV(void);
+			void disableYUV(void);
+			void drawYUV(int first, int last);
+			void redrawTexture(void);
 
 			Display *dpy;  Window win;
 			GLXContext ctx;
 			tjhandle tjhnd;
 			bool newdpy;
+
+			// In texture mode (see VGLCLIENT_GLTEXTURE), the frame is mirrored in a
+			// persistent texture (one per eye), and each redraw draws a single
+			// textured quad.  Only the regions that were decompressed since the last
+			// redraw are uploaded to the texture, using a ring of pixel unpack
+			// buffers so that the upload for one frame can overlap with the drawing
+			// of the previous frame.  The regions are recorded by decompressTile(),
+			// which may be called from multiple threads, so they are protected by
+			// dirtyMutex.
+			static const int NPBOS = 2;
+			static const int MAXDIRTY = 1024;
+			typedef struct { int x, y, width, height;  bool yuv; } Rect;
+			bool useTexture, textureInit;
+			GLuint tex[2], pbo[NPBOS];
+			int pboIndex, texWidth, texHeight;
+			Rect *dirty;
+			int nDirty, maxDirty, nYUVDirty;
+			bool allDirty;
+			vglutil::CriticalSection dirtyMutex;
+
+			// In YUV mode (see VGLCLIENT_YUVDECODE), 4:2:0 JPEG tiles are
+			// decompressed into Y, U, and V planes rather than into the frame, and
+			// the regions that were decompressed in that manner are converted to RGB
+			// by a fragment shader while rendering them into the frame's texture.
+			// Thus, the texture (rather than the frame) holds the most recent pixels
+			// for those regions.  The dirty regions are applied to the texture in
+			// the order in which they were recorded, since an RGB tile and a YUV
+			// tile may have been decompressed into the same region between redraws.
+			// yuvActive is set by init() and is false if the frame is stereo.
+			// bitsStale is set if the texture contains pixels that the frame does
+			// not, in which case the texture is read back into the frame when YUV
+			// mode becomes inactive.
+			bool useYUV, yuvActive, yuvInit, bitsStale;
+			unsigned char *yuvBuf, *planes[3];
+			int strides[3], yuvWidth, yuvHeight;
+			GLuint yuvTex[3], fbo, program;
 	};
 }
 
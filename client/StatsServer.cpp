@@ -0,0 +1,117 @@
+// Copyright (C)2020 D. R. Commander
+//
+// This library is free software and may be redistributed and/or modified under
+// the terms of the wxWindows Library License, Version 3.1 or (at your option)
+// any later version.  The full license is in the LICENSE.txt file included
+// with this distribution.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// wxWindows Library License for more details.
+
+#include "StatsServer.h"
+#include "ClientWin.h"
+#include "Error.h"
+#include "Log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+using namespace vglutil;
+using namespace vglclient;
+
+
+StatsServer::StatsServer(const char *path_) : path(NULL), listenFD(-1),
+	deadYet(false), thread(NULL)
+{
+	struct sockaddr_un addr;  struct stat sb;
+
+	wakePipe[0] = wakePipe[1] = -1;
+	if(!path_ || strlen(path_) < 1) THROW("Invalid argument");
+	if(strlen(path_) >= sizeof(addr.sun_path))
+		THROW("Statistics socket path is too long");
+
+	try
+	{
+		path = strdup(path_);
+		if(!path) THROW("Memory allocation error");
+
+		// Remove the socket left behind by a previous instance, but don't
+		// clobber anything else.
+		if(lstat(path, &sb) == 0)
+		{
+			if(!S_ISSOCK(sb.st_mode))
+				THROW("Statistics socket path exists and is not a socket");
+			if(unlink(path) < 0) THROW_UNIX();
+		}
+
+		if((listenFD = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) THROW_UNIX();
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+		if(bind(listenFD, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+			THROW_UNIX();
+		if(chmod(path, 0600) < 0) THROW_UNIX();
+		if(listen(listenFD, 8) < 0) THROW_UNIX();
+		if(pipe(wakePipe) < 0) THROW_UNIX();
+
+		NEWCHECK(thread = new Thread(this));
+		thread->start();
+	}
+	catch(...)
+	{
+		if(listenFD >= 0) { close(listenFD);  unlink(path); }
+		for(int i = 0; i < 2; i++)
+			if(wakePipe[i] >= 0) close(wakePipe[i]);
+		free(path);
+		throw;
+	}
+}
+
+
+StatsServer::~StatsServer(void)
+{
+	deadYet = true;
+	if(wakePipe[1] >= 0)
+	{
+		char c = 0;
+		if(write(wakePipe[1], &c, 1) < 0) {}
+	}
+	if(thread) { thread->stop();  delete thread;  thread = NULL; }
+	if(listenFD >= 0) { close(listenFD);  listenFD = -1;  unlink(path); }
+	for(int i = 0; i < 2; i++)
+		if(wakePipe[i] >= 0) { close(wakePipe[i]);  wakePipe[i] = -1; }
+	free(path);  path = NULL;
+}
+
+
+void StatsServer::run(void)
+{
+	while(!deadYet)
+	{
+		struct pollfd fds[2];  int fd = -1;  FILE *file = NULL;
+
+		fds[0].fd = listenFD;  fds[0].events = POLLIN;  fds[0].revents = 0;
+		fds[1].fd = wakePipe[0];  fds[1].events = POLLIN;  fds[1].revents = 0;
+		if(poll(fds, 2, -1) < 0)
+		{
+			if(errno == EINTR) continue;
+			vglout.println("[VGL] ERROR: Statistics server: %s", strerror(errno));
+			break;
+		}
+		if(deadYet || fds[1].revents) break;
+		if(!(fds[0].revents & POLLIN)) continue;
+
+		if((fd = accept(listenFD, NULL, NULL)) < 0) continue;
+		if((file = fdopen(fd, "w")) == NULL) { close(fd);  continue; }
+		ClientWin::writeStats(file);
+		fclose(file);
+	}
+}
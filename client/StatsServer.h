@@ -0,0 +1,43 @@
+// Copyright (C)2020 D. R. Commander
+//
+// This library is free software and may be redistributed and/or modified under
+// the terms of the wxWindows Library License, Version 3.1 or (at your option)
+// any later version.  The full license is in the LICENSE.txt file included
+// with this distribution.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// wxWindows Library License for more details.
+
+#ifndef __STATSSERVER_H__
+#define __STATSSERVER_H__
+
+#include "Thread.h"
+
+
+namespace vglclient
+{
+	// Listens on a Unix domain socket and, whenever a connection is accepted,
+	// writes the statistics for all windows (see ClientWin::writeStats()) to the
+	// connection and closes it (see VGLCLIENT_STATS.)  wakePipe is used to wake
+	// up the listener thread when it is shutting down.
+	class StatsServer : public vglutil::Runnable
+	{
+		public:
+
+			StatsServer(const char *path);
+			virtual ~StatsServer(void);
+
+		private:
+
+			void run(void);
+
+			char *path;
+			int listenFD, wakePipe[2];
+			bool deadYet;
+			vglutil::Thread *thread;
+	};
+}
+
+#endif  // __STATSSERVER_H__
@@ -14,6 +14,11 @@
 
 #include "VGLTransReceiver.h"
 #include "vglutil.h"
+#ifdef USEEPOLL
+#include <sys/epoll.h>
+#endif
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace vglutil;
 using namespace vglcommon;
@@ -67,6 +72,15 @@ static unsigned short DisplayNumber(Display *dpy)
 	} \
 }
 
+#define ENDIANIZE_BATCH(h) \
+{ \
+	if(!LittleEndian()) \
+	{ \
+		h.size = BYTESWAP(h.size); \
+		h.tiles = BYTESWAP(h.tiles); \
+	} \
+}
+
 #define CONVERT_HEADER(h1, h) \
 { \
 	h.size = h1.size; \
@@ -84,14 +98,20 @@ static unsigned short DisplayNumber(Display *dpy)
 }
 
 
-VGLTransReceiver::VGLTransReceiver(bool doSSL_, bool ipv6_, int drawMethod_) :
-	drawMethod(drawMethod_), listenSocket(NULL), thread(NULL), deadYet(false),
-	doSSL(doSSL_), ipv6(ipv6_)
+VGLTransReceiver::VGLTransReceiver(bool doSSL_, bool ipv6_, int drawMethod_,
+	int nprocs_, int nbufs_, bool multiplex_) : drawMethod(drawMethod_),
+	nprocs(nprocs_), nbufs(nbufs_), listenSocket(NULL), thread(NULL),
+	deadYet(false), doSSL(doSSL_), ipv6(ipv6_), multiplex(multiplex_),
+	epollFD(-1), pool(NULL), conns(NULL), nConns(0), maxConns(0)
 {
 	char *env = NULL;
 
+	wakePipe[0] = wakePipe[1] = -1;
 	if((env = getenv("VGL_VERBOSE")) != NULL && strlen(env) > 0
 		&& !strncmp(env, "1", 1)) fbx_printwarnings(vglout.getFile());
+	#ifndef USEEPOLL
+	multiplex = false;
+	#endif
 	NEWCHECK(thread = new Thread(this));
 }
 
@@ -102,7 +122,18 @@ VGLTransReceiver::~VGLTransReceiver(void)
 	listenMutex.lock();
 	if(listenSocket) listenSocket->close();
 	listenMutex.unlock();
+	if(wakePipe[1] >= 0)
+	{
+		char c = 0;
+		if(write(wakePipe[1], &c, 1) < 0) {}
+	}
 	if(thread) { thread->stop();  thread = NULL; }
+	delete pool;  pool = NULL;
+	#ifdef USEEPOLL
+	if(epollFD >= 0) { close(epollFD);  epollFD = -1; }
+	#endif
+	for(int i = 0; i < 2; i++)
+		if(wakePipe[i] >= 0) { close(wakePipe[i]);  wakePipe[i] = -1; }
 }
 
 
@@ -112,6 +143,26 @@ void VGLTransReceiver::listen(unsigned short port_)
 	{
 		NEWCHECK(listenSocket = new Socket(doSSL, ipv6));
 		port = listenSocket->listen(port_);
+		#ifdef USEEPOLL
+		if(multiplex)
+		{
+			struct epoll_event ev;
+
+			if(pipe(wakePipe) < 0) THROW_UNIX();
+			if(fcntl(wakePipe[1], F_SETFL, O_NONBLOCK) < 0
+				|| fcntl(wakePipe[0], F_SETFL, O_NONBLOCK) < 0)
+				THROW_UNIX();
+			if((epollFD = epoll_create(64)) < 0) THROW_UNIX();
+			memset(&ev, 0, sizeof(ev));
+			ev.events = EPOLLIN;  ev.data.ptr = NULL;
+			if(epoll_ctl(epollFD, EPOLL_CTL_ADD, listenSocket->getSD(), &ev) < 0)
+				THROW_UNIX();
+			ev.data.ptr = this;
+			if(epoll_ctl(epollFD, EPOLL_CTL_ADD, wakePipe[0], &ev) < 0)
+				THROW_UNIX();
+			NEWCHECK(pool = new DecodePool(nprocs, wakePipe[1]));
+		}
+		#endif
 	}
 	catch(...)
 	{
@@ -126,6 +177,11 @@ void VGLTransReceiver::run(void)
 {
 	Socket *socket = NULL;  Listener *listener = NULL;
 
+	if(multiplex)
+	{
+		runMultiplexed();
+		return;
+	}
 	while(!deadYet)
 	{
 		try
@@ -134,7 +190,8 @@ void VGLTransReceiver::run(void)
 			socket = listenSocket->accept();  if(deadYet) break;
 			vglout.println("++ %sConnection from %s.", doSSL ? "SSL " : "",
 				socket->remoteName());
-			NEWCHECK(listener = new Listener(socket, drawMethod));
+			NEWCHECK(listener = new Listener(socket, drawMethod, nprocs,
+				nbufs));
 			continue;
 		}
 		catch(Error &e)
@@ -155,19 +212,24 @@ void VGLTransReceiver::run(void)
 }
 
 
+// Returns true if the first header received from the server is a v1.0 frame
+// header rather than a request for the client's version.
+static bool isV1Header(rrframeheader_v1 &h1)
+{
+	return h1.framew != 0 && h1.frameh != 0 && h1.width != 0 && h1.height != 0
+		&& h1.winid != 0 && h1.size != 0 && h1.flags != RR_EOF;
+}
+
+
 void VGLTransReceiver::Listener::run(void)
 {
-	ClientWin *w = NULL;
-	Frame *f = NULL;
-	rrframeheader h;  rrframeheader_v1 h1;  bool haveHeader = false;
-	rrversion v;
+	bool haveHeader = false;
 
 	try
 	{
 		recv((char *)&h1, sizeof_rrframeheader_v1);
 		ENDIANIZE(h1);
-		if(h1.framew != 0 && h1.frameh != 0 && h1.width != 0 && h1.height != 0
-			&& h1.winid != 0 && h1.size != 0 && h1.flags != RR_EOF)
+		if(isV1Header(h1))
 		{
 			v.major = 1;  v.minor = 0;  haveHeader = true;
 		}
@@ -189,6 +251,33 @@ void VGLTransReceiver::Listener::run(void)
 
 		while(1)
 		{
+			if(v.major > 2 || (v.major == 2 && v.minor >= 2))
+			{
+				// Protocol v2.2 and later:  The tile index of each batch is
+				// validated, the compressed images for all of the tiles are then
+				// received using a single read, and the tiles are dispatched (without
+				// copying them) using the tile index.
+				unsigned int indexSize;
+				recv((char *)&bh, sizeof_rrbatchheader);
+				checkBatchHeader(bh);
+				indexSize = bh.tiles * sizeof_rrframeheader;
+				recv(curBatch->buf, indexSize);
+				checkBatchIndex();
+				recv(&curBatch->buf[indexSize], bh.size - indexSize);
+
+				char *bits = &curBatch->buf[indexSize];
+				for(unsigned int i = 0; i < bh.tiles; i++)
+				{
+					memcpy(&h, &curBatch->buf[i * sizeof_rrframeheader],
+						sizeof_rrframeheader);
+					ENDIANIZE(h);
+					processTile(v, h, f, bits);
+					if(h.flags != RR_EOF) bits += h.size;
+				}
+				releaseBatch();
+				continue;
+			}
+
 			do
 			{
 				if(v.major == 1 && v.minor == 0)
@@ -206,101 +295,578 @@ void VGLTransReceiver::Listener::run(void)
 					recv((char *)&h, sizeof_rrframeheader);
 					ENDIANIZE(h);
 				}
-				bool stereo = (h.flags == RR_LEFT || h.flags == RR_RIGHT);
-				unsigned short dpynum =
-					(v.major < 2 || (v.major == 2 && v.minor < 1)) ?
-					h.dpynum : DisplayNumber(maindpy);
-				ERRIFNOT(w = addWindow(dpynum, h.winid, stereo));
+				processTile(v, h, f, NULL);
+
+			} while(!(f && f->hdr.flags == RR_EOF));
+
+			if(v.major == 1 && v.minor == 0)
+			{
+				char cts = 1;
+				send(&cts, 1);
+			}
+		}
+	}
+	catch(Error &e)
+	{
+		vglout.println("%s-- %s", e.getMethod(), e.getMessage());
+	}
+	if(thread) { thread->detach();  delete thread;  thread = NULL; }
+	delete this;
+}
+
+
+// Validate a batch header, obtain a batch buffer from the pool, and make sure
+// that the buffer is large enough to receive the tile index.
+void VGLTransReceiver::Listener::checkBatchHeader(rrbatchheader &bh)
+{
+	ENDIANIZE_BATCH(bh);
+	if(bh.tiles < 1 || bh.tiles > RR_MAXBATCHTILES
+		|| bh.tiles > bh.size / sizeof_rrframeheader)
+		THROW("Invalid batch header");
+	if(!curBatch)
+	{
+		void *sb = NULL;
+		batchPool.get(&sb, true);
+		if(!sb) NEWCHECK(sb = new SharedBuffer(&batchPool));
+		curBatch = (SharedBuffer *)sb;
+		curBatch->addRef();
+	}
+	curBatch->alloc(bh.tiles * sizeof_rrframeheader);
+}
+
+
+// Validate the tile index of a batch, and make sure that the batch buffer is
+// large enough to receive the compressed images.  Since a batch contains tiles
+// from only one frame, the size of the compressed images cannot legitimately
+// exceed the worst-case compressed size of a stereo frame with the specified
+// dimensions.
+void VGLTransReceiver::Listener::checkBatchIndex(void)
+{
+	unsigned long long bytes = 0, maxBytes = 0;
+	rrframeheader th;
+
+	for(unsigned int i = 0; i < bh.tiles; i++)
+	{
+		memcpy(&th, &curBatch->buf[i * sizeof_rrframeheader],
+			sizeof_rrframeheader);
+		ENDIANIZE(th);
+		if(th.flags == RR_EOF)
+		{
+			if(i != bh.tiles - 1) THROW("Invalid tile index");
+			continue;
+		}
+		if(th.framew < 1 || th.frameh < 1 || th.width < 1 || th.height < 1
+			|| th.x + th.width > th.framew || th.y + th.height > th.frameh)
+			THROW("Invalid tile header");
+		if(maxBytes == 0)
+		{
+			unsigned long frameBytes = tjBufSize(th.framew, th.frameh, TJSAMP_444);
+			if(frameBytes == (unsigned long)-1) THROW(tjGetErrorStr());
+			maxBytes = (unsigned long long)frameBytes * 2;
+		}
+		unsigned long tileBytes = tjBufSize(th.width, th.height, TJSAMP_444);
+		if(tileBytes == (unsigned long)-1) THROW(tjGetErrorStr());
+		if(th.size > tileBytes) THROW("Invalid tile size");
+		bytes += th.size;
+	}
+	if(bytes > maxBytes
+		|| bytes != bh.size - bh.tiles * sizeof_rrframeheader)
+		THROW("Invalid batch size");
+	curBatch->alloc(bh.size);
+}
+
+
+// Release the listener's reference to the current batch.  The batch is
+// returned to the pool once all of the tiles in it have been decompressed.
+void VGLTransReceiver::Listener::releaseBatch(void)
+{
+	if(curBatch)
+	{
+		curBatch->release();  curBatch = NULL;
+	}
+}
+
+
+// Pass a tile to the appropriate window.  If bits is NULL, then the tile's
+// image data is read from the socket.  Otherwise, the tile is decompressed
+// directly from the current batch.
+void VGLTransReceiver::Listener::processTile(rrversion &v, rrframeheader &h,
+	Frame *&f, char *bits)
+{
+	ClientWin *w = beginTile(v, h, f, true, bits);
+
+	if(h.flags != RR_EOF && !bits)
+		recv((char *)(h.flags == RR_RIGHT ? f->rbits : f->bits), h.size);
+	endTile(w, h, f);
+}
+
+
+// Find or create the window to which a tile belongs, and obtain a buffer from
+// that window into which the tile can be received (the right eye of a stereo
+// tile is received into the same buffer as the left eye.)  If wait is false
+// and the window has no free buffers, then this returns NULL.  If bits is not
+// NULL, then it points to the tile's image data in the current batch.
+ClientWin *VGLTransReceiver::Listener::beginTile(rrversion &v,
+	rrframeheader &h, Frame *&f, bool wait, char *bits)
+{
+	ClientWin *w = NULL;
+
+	bool stereo = (h.flags == RR_LEFT || h.flags == RR_RIGHT);
+	unsigned short dpynum =
+		(v.major < 2 || (v.major == 2 && v.minor < 1)) ?
+		h.dpynum : DisplayNumber(maindpy);
+	ERRIFNOT(w = addWindow(dpynum, h.winid, stereo));
+
+	if(!stereo || h.flags == RR_LEFT || !f)
+	{
+		try
+		{
+			Frame *newf = w->getFrame(h.compress == RRCOMP_YUV, wait);
+			if(!newf) return NULL;
+			f = newf;
+		}
+		catch(...) { if(w) deleteWindow(w);  throw; }
+	}
+	#ifdef USEXV
+	if(h.compress == RRCOMP_YUV)
+	{
+		((XVFrame *)f)->init(h);
+		if(h.size != ((XVFrame *)f)->hdr.size && h.flags != RR_EOF)
+			THROW("YUV image size mismatch");
+		// XVideo images are drawn from shared memory, so they must be copied.
+		if(bits && h.flags != RR_EOF) memcpy(f->bits, bits, h.size);
+	}
+	else
+	#endif
+	if(bits && h.flags != RR_EOF)
+		((CompressedFrame *)f)->initExternal(h, h.flags, (unsigned char *)bits,
+			curBatch);
+	else ((CompressedFrame *)f)->init(h, h.flags, h.size);
+	return w;
+}
+
+
+// Pass a tile, whose image data has been received, to its window.
+void VGLTransReceiver::Listener::endTile(ClientWin *w, rrframeheader &h,
+	Frame *f)
+{
+	bool stereo = (h.flags == RR_LEFT || h.flags == RR_RIGHT);
+
+	if(!stereo || h.flags != RR_LEFT)
+	{
+		try
+		{
+			w->drawFrame(f);
+		}
+		catch(...) { if(w) deleteWindow(w);  throw; }
+	}
+}
 
-				if(!stereo || h.flags == RR_LEFT || !f)
+
+#ifdef USEEPOLL
+
+void VGLTransReceiver::runMultiplexed(void)
+{
+	static const int MAXEVENTS = 64;
+	struct epoll_event events[MAXEVENTS];
+	int i, n;
+
+	while(!deadYet)
+	{
+		if((n = epoll_wait(epollFD, events, MAXEVENTS, -1)) < 0)
+		{
+			if(errno == EINTR) continue;
+			vglout.println("epoll_wait() failed-- %s", strerror(errno));
+			break;
+		}
+		if(deadYet) break;
+
+		for(i = 0; i < n; i++)
+		{
+			if(events[i].data.ptr == NULL)
+			{
+				Socket *socket = NULL;  Listener *listener = NULL;
+				try
 				{
-					try
+					socket = listenSocket->accept();
+					vglout.println("++ %sConnection from %s.", doSSL ? "SSL " : "",
+						socket->remoteName());
+					NEWCHECK(listener = new Listener(socket, drawMethod, nprocs,
+						nbufs, pool));
+					if(nConns >= maxConns)
 					{
-						f = w->getFrame(h.compress == RRCOMP_YUV);
+						int newMax = maxConns ? maxConns * 2 : 16;
+						Listener **newConns =
+							(Listener **)realloc(conns, sizeof(Listener *) * newMax);
+						if(!newConns) THROW("Memory allocation error");
+						conns = newConns;  maxConns = newMax;
 					}
-					catch(...) { if(w) deleteWindow(w);  throw; }
+					struct epoll_event ev;
+					memset(&ev, 0, sizeof(ev));
+					ev.events = listener->epollEvents = EPOLLIN;
+					ev.data.ptr = listener;
+					if(epoll_ctl(epollFD, EPOLL_CTL_ADD, socket->getSD(), &ev) < 0)
+						THROW_UNIX();
+					conns[nConns++] = listener;
 				}
-				#ifdef USEXV
-				if(h.compress == RRCOMP_YUV)
+				catch(Error &e)
 				{
-					((XVFrame *)f)->init(h);
-					if(h.size != ((XVFrame *)f)->hdr.size && h.flags != RR_EOF)
-						THROW("YUV image size mismatch");
+					vglout.println("%s-- %s", e.getMethod(), e.getMessage());
+					if(listener) delete listener;
+					else delete socket;
 				}
-				else
-				#endif
-				((CompressedFrame *)f)->init(h, h.flags);
-				if(h.flags != RR_EOF)
-					recv((char *)(h.flags == RR_RIGHT ? f->rbits : f->bits), h.size);
+			}
+			else if(events[i].data.ptr == this)
+			{
+				// A window that stalled a connection has a free receive buffer
+				char buf[256];
+				while(read(wakePipe[0], buf, 256) > 0) {}
+				for(int j = 0; j < nConns; j++)
+					if(conns[j]->stalled && !conns[j]->closed) service(conns[j]);
+			}
+			else
+			{
+				Listener *listener = (Listener *)events[i].data.ptr;
+				if(!listener->closed) service(listener);
+			}
+		}
 
-				if(!stereo || h.flags != RR_LEFT)
-				{
-					try
-					{
-						w->drawFrame(f);
-					}
-					catch(...) { if(w) deleteWindow(w);  throw; }
-				}
+		// Connections are deleted only after all of the events returned by
+		// epoll_wait() have been handled, since more than one event may refer
+		// to the same connection.
+		for(i = 0; i < nConns; i++)
+		{
+			if(conns[i]->closed)
+			{
+				delete conns[i];
+				conns[i] = conns[nConns - 1];  conns[nConns - 1] = NULL;
+				nConns--;  i--;
+			}
+		}
+	}
 
-			} while(!(f && f->hdr.flags == RR_EOF));
+	for(i = 0; i < nConns; i++) delete conns[i];
+	free(conns);  conns = NULL;  nConns = maxConns = 0;
+	vglout.println("Listener exiting ...");
+	listenMutex.lock();
+	delete listenSocket;  listenSocket = NULL;
+	listenMutex.unlock();
+}
 
-			if(v.major == 1 && v.minor == 0)
+
+// Send and receive as much data as possible on a connection, stop polling the
+// connection for readability while it is stalled, and poll it for writability
+// while it has messages waiting to be sent.
+void VGLTransReceiver::service(Listener *listener)
+{
+	if(!listener->process())
+	{
+		epoll_ctl(epollFD, EPOLL_CTL_DEL, listener->getSocket()->getSD(), NULL);
+		listener->closed = true;
+		return;
+	}
+	unsigned int events = (listener->stalled ? 0 : (unsigned int)EPOLLIN)
+		| (listener->sendPending() ? (unsigned int)EPOLLOUT : 0);
+	if(events != listener->epollEvents)
+	{
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = listener->epollEvents = events;
+		ev.data.ptr = listener;
+		epoll_ctl(epollFD, EPOLL_CTL_MOD, listener->getSocket()->getSD(), &ev);
+	}
+}
+
+#else
+
+void VGLTransReceiver::runMultiplexed(void) {}
+void VGLTransReceiver::service(Listener *listener) {}
+
+#endif
+
+
+// Send any queued messages, receive as much data from the server as is
+// available without blocking, and process each header, tile, or batch as soon
+// as it has been completely received.  Returns false if the connection was
+// closed or an error occurred.
+bool VGLTransReceiver::Listener::process(void)
+{
+	try
+	{
+		flushSend();
+		while(1)
+		{
+			if(stalled)
 			{
-				char cts = 1;
-				send(&cts, 1);
+				stalled = false;
+				retry();
+				if(stalled) return true;
+				continue;
 			}
+			if(have < need)
+			{
+				have += socket->recvSome(&dst[have], need - have);
+				if(have < need) return true;
+			}
+			advance();
+			if(stalled) return true;
 		}
 	}
 	catch(Error &e)
 	{
 		vglout.println("%s-- %s", e.getMethod(), e.getMessage());
 	}
-	if(thread) { thread->detach();  delete thread;  thread = NULL; }
-	delete this;
+	return false;
+}
+
+
+// Queue a message to the server, and send as much of the queue as possible
+// without blocking.
+void VGLTransReceiver::Listener::queueSend(char *buf, int len)
+{
+	if(len > SENDQUEUE - sendLen) THROW("Send queue overflow");
+	memcpy(&sendQueue[sendLen], buf, len);
+	sendLen += len;
+	flushSend();
+}
+
+
+void VGLTransReceiver::Listener::flushSend(void)
+{
+	if(sendLen < 1) return;
+	int sent = socket->sendSome(sendQueue, sendLen);
+	if(sent > 0 && sent < sendLen)
+		memmove(sendQueue, &sendQueue[sent], sendLen - sent);
+	sendLen -= sent;
+}
+
+
+void VGLTransReceiver::Listener::expect(int state_, char *dst_,
+	unsigned int need_)
+{
+	state = state_;  dst = dst_;  need = need_;  have = 0;
+}
+
+
+void VGLTransReceiver::Listener::nextHeader(void)
+{
+	if(framed())
+		expect(RECV_BATCHHEADER, (char *)&bh, sizeof_rrbatchheader);
+	else if(v.major == 1 && v.minor == 0)
+		expect(RECV_HEADER, (char *)&h1, sizeof_rrframeheader_v1);
+	else expect(RECV_HEADER, (char *)&h, sizeof_rrframeheader);
+}
+
+
+// Called once the buffer for the current state has been completely received
+void VGLTransReceiver::Listener::advance(void)
+{
+	switch(state)
+	{
+		case RECV_HELLO:
+			ENDIANIZE(h1);
+			if(isV1Header(h1))
+			{
+				v.major = 1;  v.minor = 0;
+				CONVERT_HEADER(h1, h);
+				startTile();
+			}
+			else
+			{
+				memcpy(v.id, "VGL", 3);
+				v.major = RR_MAJOR_VERSION;  v.minor = RR_MINOR_VERSION;
+				queueSend((char *)&v, sizeof_rrversion);
+				expect(RECV_VERSION, (char *)&v, sizeof_rrversion);
+			}
+			break;
+		case RECV_VERSION:
+		{
+			if(strncmp(v.id, "VGL", 3) || v.major < 1)
+				THROW("Error reading server version");
+			char *env = NULL;
+			if((env = getenv("VGL_VERBOSE")) != NULL && strlen(env) > 0
+				&& !strncmp(env, "1", 1))
+				vglout.println("Server version: %d.%d", v.major, v.minor);
+			nextHeader();
+			break;
+		}
+		case RECV_HEADER:
+			if(v.major == 1 && v.minor == 0)
+			{
+				ENDIANIZE_V1(h1);
+				CONVERT_HEADER(h1, h);
+			}
+			else ENDIANIZE(h);
+			startTile();
+			break;
+		case RECV_TILE:
+			finishTile();
+			break;
+		case RECV_BATCHHEADER:
+			checkBatchHeader(bh);
+			expect(RECV_BATCHINDEX, curBatch->buf, bh.tiles * sizeof_rrframeheader);
+			break;
+		case RECV_BATCHINDEX:
+		{
+			unsigned int indexSize = bh.tiles * sizeof_rrframeheader;
+			checkBatchIndex();
+			expect(RECV_BATCH, &curBatch->buf[indexSize], bh.size - indexSize);
+			batchTile = 0;
+			batchBits = &curBatch->buf[indexSize];
+			break;
+		}
+		case RECV_BATCH:
+			processBatch();
+			break;
+		default:
+			THROW("Invalid receive state");
+	}
+}
+
+
+// Retry the tile that stalled the connection
+void VGLTransReceiver::Listener::retry(void)
+{
+	if(state == RECV_BATCH) processBatch();
+	else startTile();
+}
+
+
+// Called once a tile header (h) has been received
+void VGLTransReceiver::Listener::startTile(void)
+{
+	if(!(curWin = beginTile(v, h, f, false)))
+	{
+		stalled = true;
+		return;
+	}
+	if(h.flags != RR_EOF && h.size > 0)
+		expect(RECV_TILE, (char *)(h.flags == RR_RIGHT ? f->rbits : f->bits),
+			h.size);
+	else finishTile();
+}
+
+
+void VGLTransReceiver::Listener::finishTile(void)
+{
+	endTile(curWin, h, f);
+	if(v.major == 1 && v.minor == 0 && h.flags == RR_EOF)
+	{
+		char cts = 1;
+		queueSend(&cts, 1);
+	}
+	nextHeader();
+}
+
+
+// Dispatch the tiles in a framed batch that has been completely received,
+// starting with batchTile (which is non-zero if a previous attempt stalled.)
+void VGLTransReceiver::Listener::processBatch(void)
+{
+	for(; batchTile < bh.tiles; batchTile++)
+	{
+		memcpy(&h, &curBatch->buf[batchTile * sizeof_rrframeheader],
+			sizeof_rrframeheader);
+		ENDIANIZE(h);
+		ClientWin *w = beginTile(v, h, f, false, batchBits);
+		if(!w)
+		{
+			stalled = true;
+			return;
+		}
+		if(h.flags != RR_EOF) batchBits += h.size;
+		endTile(w, h, f);
+	}
+	releaseBatch();
+	nextHeader();
 }
 
 
 void VGLTransReceiver::Listener::deleteWindow(ClientWin *w)
 {
-	int i, j;
 	CriticalSection::SafeLock l(winMutex);
 
-	if(nwin > 0)
+	for(int i = 0; i < winTableSize; i++)
 	{
-		for(i = 0; i < nwin; i++)
+		for(WinEntry **entry = &winTable[i]; *entry; entry = &(*entry)->next)
 		{
-			if(windows[i] == w)
+			if((*entry)->win == w)
 			{
-				delete w;  windows[i] = NULL;
-				if(i < nwin - 1)
-					for(j = i; j < nwin - 1; j++) windows[j] = windows[j + 1];
-				windows[nwin - 1] = NULL;  nwin--;  break;
+				WinEntry *next = (*entry)->next;
+				if(lastWin == *entry) lastWin = NULL;
+				delete w;  delete *entry;
+				*entry = next;  nwin--;
+				return;
 			}
 		}
 	}
 }
 
 
+// Rehash the window table into newSize (a power of 2) buckets
+void VGLTransReceiver::Listener::resizeWinTable(int newSize)
+{
+	WinEntry **newTable = NULL;
+
+	if(!(newTable = (WinEntry **)calloc(newSize, sizeof(WinEntry *))))
+		THROW("Memory allocation error");
+	for(int i = 0; i < winTableSize; i++)
+	{
+		while(winTable[i])
+		{
+			WinEntry *entry = winTable[i];
+			winTable[i] = entry->next;
+			unsigned int bucket =
+				hashWindow(entry->dpynum, entry->winid) & (newSize - 1);
+			entry->next = newTable[bucket];  newTable[bucket] = entry;
+		}
+	}
+	free(winTable);
+	winTable = newTable;  winTableSize = newSize;
+}
+
+
 // Register a new window with this server
 ClientWin *VGLTransReceiver::Listener::addWindow(int dpynum, Window win,
 	bool stereo)
 {
 	CriticalSection::SafeLock l(winMutex);
-	int winid = nwin;
+	WinEntry *entry = NULL;
 
-	if(nwin > 0)
+	if(lastWin && lastWin->winid == win && lastWin->dpynum == dpynum)
+		return lastWin->win;
+	if(winTableSize > 0)
 	{
-		for(winid = 0; winid < nwin; winid++)
-			if(windows[winid] && windows[winid]->match(dpynum, win))
-				return windows[winid];
+		unsigned int bucket = hashWindow(dpynum, win) & (winTableSize - 1);
+		for(entry = winTable[bucket]; entry; entry = entry->next)
+		{
+			if(entry->winid == win && entry->dpynum == dpynum)
+			{
+				lastWin = entry;
+				return entry->win;
+			}
+		}
 	}
-	if(nwin >= MAXWIN) THROW("No free window IDs");
 	if(dpynum < 0 || dpynum > 65535 || win == None) THROW("Invalid argument");
-	NEWCHECK(windows[winid] = new ClientWin(dpynum, win, drawMethod, stereo));
+	if(nwin >= winTableSize)
+		resizeWinTable(winTableSize ? winTableSize * 2 : 16);
 
-	if(!windows[winid]) THROW("Could not create window instance");
+	NEWCHECK(entry = new WinEntry);
+	entry->dpynum = dpynum;  entry->winid = win;  entry->win = NULL;
+	try
+	{
+		NEWCHECK(entry->win = new ClientWin(dpynum, win, drawMethod, nprocs,
+			nbufs, stereo, pool));
+	}
+	catch(...)
+	{
+		delete entry;  throw;
+	}
+	unsigned int bucket = hashWindow(dpynum, win) & (winTableSize - 1);
+	entry->next = winTable[bucket];  winTable[bucket] = entry;
 	nwin++;
-	return windows[winid];
+	lastWin = entry;
+	return entry->win;
 }
 
 
@@ -21,7 +21,9 @@
 #include "Error.h"
 
 
-#define MAXWIN  1024
+#ifdef __linux__
+#define USEEPOLL
+#endif
 
 
 namespace vglclient
@@ -30,7 +32,8 @@ namespace vglclient
 	{
 		public:
 
-			VGLTransReceiver(bool doSSL, bool ipv6, int drawmethod);
+			VGLTransReceiver(bool doSSL, bool ipv6, int drawmethod, int nprocs,
+				int nbufs, bool multiplex = false);
 			void listen(unsigned short port);
 			unsigned short getPort(void) { return port; }
 			virtual ~VGLTransReceiver(void);
@@ -39,7 +42,7 @@ namespace vglclient
 
 			void run(void);
 
-			int drawMethod;
+			int drawMethod, nprocs, nbufs;
 			vglutil::Socket *listenSocket;
 			vglutil::CriticalSection listenMutex;
 			vglutil::Thread *thread;
@@ -48,52 +51,181 @@ namespace vglclient
 			bool ipv6;
 			unsigned short port;
 
+			// In multiplexed mode (see VGLCLIENT_MULTIPLEX), the receiver thread
+			// uses epoll to accept new connections and to receive data from all of
+			// the existing connections, and the frames for all windows are
+			// decompressed and drawn by a single DecodePool.  Thus, the number of
+			// threads does not depend on the number of connections or windows.
+			// wakePipe is used to wake up the receiver thread when it is shutting
+			// down or when a stalled connection can resume (see
+			// Listener::process().)
+			class Listener;
+			void runMultiplexed(void);
+			void service(Listener *listener);
+			bool multiplex;
+			int epollFD, wakePipe[2];
+			DecodePool *pool;
+			Listener **conns;
+			int nConns, maxConns;
+
 		class Listener : public vglutil::Runnable
 		{
 			public:
 
-				Listener(vglutil::Socket *socket_, int drawMethod_) :
-					drawMethod(drawMethod_), nwin(0), socket(socket_), thread(NULL),
-					remoteName(NULL)
+				Listener(vglutil::Socket *socket_, int drawMethod_, int nprocs_,
+					int nbufs_, DecodePool *pool_ = NULL) : stalled(false),
+					closed(false), epollEvents(0), drawMethod(drawMethod_),
+					nprocs(nprocs_), nbufs(nbufs_), winTable(NULL), winTableSize(0),
+					nwin(0), lastWin(NULL), socket(socket_),
+					thread(NULL), remoteName(NULL), curBatch(NULL), pool(pool_),
+					f(NULL), curWin(NULL), sendLen(0)
 				{
-					memset(windows, 0, sizeof(ClientWin *) * MAXWIN);
 					if(socket) remoteName = socket->remoteName();
+					if(pool)
+					{
+						socket->setNonBlocking(true);
+						expect(RECV_HELLO, (char *)&h1, sizeof_rrframeheader_v1);
+						return;
+					}
 					NEWCHECK(thread = new vglutil::Thread(this));
 					thread->start();
 				}
 
 				virtual ~Listener(void)
 				{
-					int i;
-
 					winMutex.lock(false);
-					for(i = 0; i < nwin; i++)
+					for(int i = 0; i < winTableSize; i++)
 					{
-						delete windows[i];  windows[i] = NULL;
+						while(winTable[i])
+						{
+							WinEntry *next = winTable[i]->next;
+							delete winTable[i]->win;  delete winTable[i];
+							winTable[i] = next;
+						}
 					}
-					nwin = 0;
+					free(winTable);  winTable = NULL;
+					nwin = winTableSize = 0;  lastWin = NULL;
 					winMutex.unlock(false);
 					if(!remoteName) vglout.PRINTLN("-- Disconnecting\n");
 					else vglout.PRINTLN("-- Disconnecting %s", remoteName);
 					delete socket;  socket = NULL;
+					// The windows have released all of their references to the batch
+					// buffers, so all of the buffers are now in the pool.
+					releaseBatch();
+					while(1)
+					{
+						void *sb = NULL;
+						batchPool.get(&sb, true);  if(!sb) break;
+						delete (vglcommon::SharedBuffer *)sb;
+					}
 				}
 
 				void send(char *buf, int len);
 				void recv(char *buf, int len);
+				bool process(void);
+				bool sendPending(void) { return sendLen > 0; }
+				vglutil::Socket *getSocket(void) { return socket; }
+
+				bool stalled, closed;
+				unsigned int epollEvents;
 
 			private:
 
 				void run(void);
-
-				int drawMethod;
-				ClientWin *windows[MAXWIN];
-				int nwin;
+				void processTile(rrversion &v, rrframeheader &h,
+					vglcommon::Frame *&f, char *bits);
+				ClientWin *beginTile(rrversion &v, rrframeheader &h,
+					vglcommon::Frame *&f, bool wait, char *bits = NULL);
+				void endTile(ClientWin *w, rrframeheader &h, vglcommon::Frame *f);
+				void checkBatchHeader(rrbatchheader &bh);
+				void checkBatchIndex(void);
+				void releaseBatch(void);
+
+				int drawMethod, nprocs, nbufs;
+
+				// The windows are stored in a hash table (with chaining) keyed by
+				// display number and X window ID, which is grown as needed.  Since
+				// consecutive tiles usually belong to the same window, the entry that
+				// was found most recently is checked first.
+				typedef struct WinEntryStruct
+				{
+					int dpynum;  Window winid;
+					ClientWin *win;
+					struct WinEntryStruct *next;
+				} WinEntry;
+				static unsigned int hashWindow(int dpynum, Window winid)
+				{
+					unsigned int h =
+						(unsigned int)(winid ^ ((unsigned long)dpynum << 24)) * 2654435761U;
+					return h ^ (h >> 16);
+				}
+				void resizeWinTable(int newSize);
+				WinEntry **winTable;
+				int winTableSize, nwin;
+				WinEntry *lastWin;
 				ClientWin *addWindow(int dpynum, Window win, bool stereo = false);
 				void deleteWindow(ClientWin *win);
 				vglutil::CriticalSection winMutex;
 				vglutil::Socket *socket;
 				vglutil::Thread *thread;
 				const char *remoteName;
+				// Framed batches (protocol v2.2 and later) are received into a pool of
+				// shared buffers, and the tiles are decompressed directly from those
+				// buffers.  Each compressed frame that refers to a batch holds a
+				// reference to it, and the batch is returned to the pool once all of
+				// its tiles have been decompressed.  The pool grows as needed, but the
+				// number of batches that are in use is limited by the number of
+				// receive buffers that the windows have.
+				vglutil::GenericQ batchPool;
+				vglcommon::SharedBuffer *curBatch;
+
+				// In multiplexed mode, the connection is driven by process(), which
+				// receives as much data as is available without blocking.  dst
+				// points to the header or image buffer that is being received, and
+				// the connection state is advanced once need bytes have been
+				// received into it.  If a window has no free receive buffers, then
+				// the connection stalls (stops receiving) until the window returns a
+				// buffer, at which point the tile that caused the stall is retried.
+				enum
+				{
+					RECV_HELLO, RECV_VERSION, RECV_HEADER, RECV_TILE, RECV_BATCHHEADER,
+					RECV_BATCHINDEX, RECV_BATCH
+				};
+				void expect(int state, char *dst, unsigned int need);
+				void nextHeader(void);
+				void advance(void);
+				void retry(void);
+				void startTile(void);
+				void finishTile(void);
+				void processBatch(void);
+				void queueSend(char *buf, int len);
+				void flushSend(void);
+				bool framed(void)
+				{
+					return v.major > 2 || (v.major == 2 && v.minor >= 2);
+				}
+
+				DecodePool *pool;
+				int state;
+				char *dst;
+				unsigned int need, have;
+				rrframeheader h;  rrframeheader_v1 h1;  rrbatchheader bh;
+				rrversion v;
+				vglcommon::Frame *f;
+				ClientWin *curWin;
+				unsigned int batchTile;
+				char *batchBits;
+
+				// In multiplexed mode, messages to the server (the version and
+				// clear-to-send messages) are queued and sent without blocking.  The
+				// connection is polled for writability until the queue has been
+				// flushed.  The server waits for each message before sending more
+				// data, so the queue never holds more than one or two messages.  The
+				// queue is never moved, as required by SSL_write() when a send is
+				// retried.
+				static const int SENDQUEUE = 64;
+				char sendQueue[SENDQUEUE];
+				int sendLen;
 		};
 	};
 }
@@ -19,6 +19,7 @@
 #include <signal.h>
 #include <fcntl.h>
 #include "VGLTransReceiver.h"
+#include "StatsServer.h"
 #include "vglutil.h"
 #include "x11err.h"
 #include <X11/Xatom.h>
@@ -47,6 +48,9 @@ bool doSSL = true, doNonSSL = true;
 #endif
 bool ipv6 = false;
 int drawMethod = RR_DRAWAUTO;
+int nprocs = 0, nbufs = 32;
+bool multiplex = false;
+char *statsPath = NULL;
 Display *maindpy = NULL;
 bool detach = false, force = false, child = false;
 char *logFile = NULL;
@@ -228,6 +232,16 @@ void usage(char **argv)
 	fprintf(stderr, "-kill = Kill all detached VirtualGL Client processes running under this user ID\n");
 	fprintf(stderr, "-l = Redirect all output to <file>\n");
 	fprintf(stderr, "-v = Display version information\n");
+	fprintf(stderr, "-np <n> = Use <n> threads to decompress each window's frames\n");
+	fprintf(stderr, "           (default: the number of CPU cores in this system)\n");
+	fprintf(stderr, "-buffers <n> = Use <n> buffers to receive each window's compressed tiles\n");
+	fprintf(stderr, "                (default: 32)\n");
+	#ifdef __linux__
+	fprintf(stderr, "-multiplex = Receive data from all connections using a single thread, and\n");
+	fprintf(stderr, "             decompress all windows' frames using a single pool of -np threads\n");
+	#endif
+	fprintf(stderr, "-stats <path> = Report latency statistics for all windows to any process that\n");
+	fprintf(stderr, "                connects to a Unix domain socket at <path>\n");
 	fprintf(stderr, "-x = Use X11 drawing (default)\n");
 	fprintf(stderr, "-gl = Use OpenGL drawing\n\n");
 	exit(1);
@@ -337,6 +351,17 @@ void getEnvironment(void)
 	if((env = getenv("VGLCLIENT_IPV6")) != NULL && strlen(env) > 0
 		&& (temp = atoi(env)) == 1)
 		ipv6 = true;
+	if((env = getenv("VGLCLIENT_NPROCS")) != NULL && strlen(env) > 0
+		&& (temp = atoi(env)) > 0)
+		nprocs = temp;
+	if((env = getenv("VGLCLIENT_BUFFERS")) != NULL && strlen(env) > 0
+		&& (temp = atoi(env)) > 0)
+		nbufs = temp;
+	if((env = getenv("VGLCLIENT_MULTIPLEX")) != NULL && strlen(env) > 0
+		&& (temp = atoi(env)) == 1)
+		multiplex = true;
+	if((env = getenv("VGLCLIENT_STATS")) != NULL && strlen(env) > 0)
+		statsPath = env;
 }
 
 
@@ -384,6 +409,19 @@ int main(int argc, char *argv[])
 				}
 				else fclose(f);
 			}
+			else if(!stricmp(argv[i], "-np") && i < argc - 1)
+			{
+				nprocs = atoi(argv[++i]);
+			}
+			else if(!stricmp(argv[i], "-buffers") && i < argc - 1)
+			{
+				nbufs = atoi(argv[++i]);
+			}
+			else if(!stricmp(argv[i], "-multiplex")) multiplex = true;
+			else if(!stricmp(argv[i], "-stats") && i < argc - 1)
+			{
+				statsPath = argv[++i];
+			}
 			else if(!stricmp(argv[i], "-x")) drawMethod = RR_DRAWX11;
 			else if(!stricmp(argv[i], "-gl")) drawMethod = RR_DRAWOGL;
 			else if(!stricmp(argv[i], "-display") && i < argc - 1)
@@ -392,6 +430,7 @@ int main(int argc, char *argv[])
 			}
 			else usage(argv);
 		}
+		if(nprocs < 1) nprocs = NumProcs();
 
 		if(!child)
 		{
@@ -415,6 +454,7 @@ int main(int argc, char *argv[])
 int start(char *displayname)
 {
 	VGLTransReceiver *receiver = NULL;
+	StatsServer *statsServer = NULL;
 	Atom portAtom = None;  unsigned short actualPort = 0;
 	#ifdef USESSL
 	VGLTransReceiver *sslReceiver = NULL;
@@ -445,7 +485,8 @@ int start(char *displayname)
 			if(!force) actualSSLPort = instanceCheckSSL(maindpy);
 			if(actualSSLPort == 0)
 			{
-				NEWCHECK(sslReceiver = new VGLTransReceiver(true, ipv6, drawMethod));
+				NEWCHECK(sslReceiver = new VGLTransReceiver(true, ipv6, drawMethod,
+					nprocs, nbufs, multiplex));
 				if(sslPort == 0)
 				{
 					bool success = false;  unsigned short i = RR_DEFAULTSSLPORT;
@@ -484,7 +525,8 @@ int start(char *displayname)
 			if(!force) actualPort = instanceCheck(maindpy);
 			if(actualPort == 0)
 			{
-				NEWCHECK(receiver = new VGLTransReceiver(false, ipv6, drawMethod));
+				NEWCHECK(receiver = new VGLTransReceiver(false, ipv6, drawMethod,
+					nprocs, nbufs, multiplex));
 				if(port == 0)
 				{
 					bool success = false;  unsigned short i = RR_DEFAULTPORT;
@@ -522,6 +564,20 @@ int start(char *displayname)
 			vglout.logTo(logFile);
 		}
 
+		if(statsPath)
+		{
+			try
+			{
+				NEWCHECK(statsServer = new StatsServer(statsPath));
+				vglout.println("Reporting statistics on %s", statsPath);
+			}
+			catch(Error &e)
+			{
+				vglout.println("Could not create statistics socket %s:\n%s-- %s",
+					statsPath, e.getMethod(), e.getMessage());
+			}
+		}
+
 		if(child)
 		{
 			printf("%d\n", actualPort);
@@ -548,6 +604,7 @@ int start(char *displayname)
 		retval = -1;
 	}
 
+	delete statsServer;  statsServer = NULL;
 	delete receiver;  receiver = NULL;
 	#ifdef USESSL
 	delete sslReceiver;  sslReceiver = NULL;
@@ -18,6 +18,9 @@
 #include <string.h>
 #include "vgllogo.h"
 #include "Frame.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace vglutil;
 using namespace vglcommon;
@@ -29,6 +32,8 @@ using namespace vglcommon;
 			(s == 1 ? TJ_444 : \
 				(s == 0 ? TJ_GRAYSCALE : TJ_444))))
 
+#define PAD(v, p)  (((v) + (p) - 1) & (~((p) - 1)))
+
 static int tjpf[PIXELFORMATS] =
 {
 	TJPF_RGB, TJPF_RGBX, -1, TJPF_BGR, TJPF_BGRX, -1, TJPF_XBGR, -1, TJPF_XRGB,
@@ -39,9 +44,11 @@ static int tjpf[PIXELFORMATS] =
 // Uncompressed frame
 
 Frame::Frame(bool primary_) : bits(NULL), rbits(NULL), pitch(0), flags(0),
-	pf(pf_get(-1)), isGL(false), isXV(false), stereo(false), primary(primary_)
+	chromaPitch(0), pf(pf_get(-1)), isGL(false), isXV(false), stereo(false),
+	primary(primary_), external(false)
 {
 	memset(&hdr, 0, sizeof(rrframeheader));
+	chroma[0] = chroma[1] = NULL;
 	ready.wait();
 }
 
@@ -56,8 +63,10 @@ void Frame::deInit(void)
 {
 	if(primary)
 	{
-		delete [] bits;  bits = NULL;
+		if(!external) delete [] bits;
+		bits = NULL;  external = false;
 		delete [] rbits;  rbits = NULL;
+		chroma[0] = chroma[1] = NULL;
 	}
 }
 
@@ -71,6 +80,7 @@ void Frame::init(rrframeheader &h, int pixelFormat, int flags_, bool stereo_)
 	PF *newpf = pf_get(pixelFormat);
 	if(h.size == 0) h.size = h.framew * h.frameh * newpf->size;
 	checkHeader(h);
+	if(external) { bits = NULL;  external = false; }
 	if(h.framew != hdr.framew || h.frameh != hdr.frameh
 		|| newpf->size != pf->size || !bits)
 	{
@@ -92,6 +102,7 @@ void Frame::init(rrframeheader &h, int pixelFormat, int flags_, bool stereo_)
 		delete [] rbits;  rbits = NULL;
 	}
 	pf = newpf;  pitch = pf->size * h.framew;  stereo = stereo_;  hdr = h;
+	chroma[0] = chroma[1] = NULL;
 }
 
 
@@ -111,40 +122,143 @@ void Frame::init(unsigned char *bits_, int width, int pitch_, int height,
 	checkHeader(hdr);
 	pitch = pitch_;
 	flags = flags_;
+	chroma[0] = chroma[1] = NULL;
 	primary = false;
 }
 
 
+// Initialize a primary frame using a pixel buffer (with the specified pitch)
+// that is owned by the caller and that remains valid until the frame is
+// reinitialized or destroyed.  The frame's own pixel buffers are freed.
+void Frame::initExternal(rrframeheader &h, int pixelFormat, int flags_,
+	unsigned char *bits_, int pitch_)
+{
+	if(!primary || !bits_ || pixelFormat < 0 || pixelFormat >= PIXELFORMATS)
+		throw(Error("Frame::initExternal", "Invalid argument"));
+
+	flags = flags_;
+	pf = pf_get(pixelFormat);
+	if(h.size == 0) h.size = h.framew * h.frameh * pf->size;
+	checkHeader(h);
+	if(pitch_ < h.framew * pf->size)
+		throw(Error("Frame::initExternal", "Invalid argument"));
+	if(!external) delete [] bits;
+	delete [] rbits;  rbits = NULL;
+	bits = bits_;  external = true;
+	pitch = pitch_;  stereo = false;  hdr = h;
+	chroma[0] = chroma[1] = NULL;
+}
+
+
+// Initialize a primary frame as a top-down planar YUV 4:2:0 image (primary
+// frames only.)  The three planes share a single buffer and a common pitch, so
+// they can be read back from a single GPU surface.  The Y plane occupies the
+// first hdr.frameh rows, and the U and V planes (each with half the width and
+// half the height of the Y plane, rounded up) sit side by side below it.  The
+// frame has the PF_COMP pixel format, so it can be compared and tiled in the
+// same way as an RGB frame, except that tiles must start at even coordinates.
+void Frame::initYUV(rrframeheader &h)
+{
+	int chromaw = (h.framew + 1) / 2, chromah = (h.frameh + 1) / 2,
+		newPitch = chromaw * 2;
+
+	if(!primary) throw(Error("Frame::initYUV", "Invalid argument"));
+
+	if(h.size == 0) h.size = newPitch * (h.frameh + chromah);
+	checkHeader(h);
+	if(external) { bits = NULL;  external = false; }
+	if(h.framew != hdr.framew || h.frameh != hdr.frameh || !chroma[0] || !bits)
+	{
+		delete [] bits;
+		NEWCHECK(bits = new unsigned char[newPitch * (h.frameh + chromah) + 1]);
+	}
+	delete [] rbits;  rbits = NULL;
+	pf = pf_get(PF_COMP);  flags = 0;  stereo = false;  hdr = h;
+	pitch = chromaPitch = newPitch;
+	chroma[0] = &bits[pitch * h.frameh];
+	chroma[1] = &chroma[0][chromaw];
+}
+
+
 Frame *Frame::getTile(int x, int y, int width, int height)
 {
 	Frame *f;
 
+	NEWCHECK(f = new Frame(false));
+	try
+	{
+		getTile(*f, x, y, width, height);
+	}
+	catch(...)
+	{
+		delete f;  throw;
+	}
+	return f;
+}
+
+
+// Initialize tile as a view of the specified region of this frame, without
+// copying or allocating anything.  tile must have been constructed as a
+// non-primary frame, so it does not attempt to free the pixel buffers.
+void Frame::getTile(Frame &tile, int x, int y, int width, int height)
+{
 	if(!bits || !pitch || !pf->size) THROW("Frame not initialized");
 	if(x < 0 || y < 0 || width < 1 || height < 1 || (x + width) > hdr.width
 		|| (y + height) > hdr.height)
 		throw Error("Frame::getTile", "Argument out of range");
-
-	NEWCHECK(f = new Frame(false));
-	f->hdr = hdr;
-	f->hdr.x = x;
-	f->hdr.y = y;
-	f->hdr.width = width;
-	f->hdr.height = height;
-	f->pf = pf;
-	f->flags = flags;
-	f->pitch = pitch;
-	f->stereo = stereo;
-	f->isGL = isGL;
+	if(tile.primary) THROW("Tile must be a non-primary frame");
+
+	tile.hdr = hdr;
+	tile.hdr.x = x;
+	tile.hdr.y = y;
+	tile.hdr.width = width;
+	tile.hdr.height = height;
+	tile.pf = pf;
+	tile.flags = flags;
+	tile.pitch = pitch;
+	tile.stereo = stereo;
+	tile.isGL = isGL;
 	bool bu = (flags & FRAME_BOTTOMUP);
-	f->bits = &bits[pitch * (bu ? hdr.height - y - height : y) + pf->size * x];
+	tile.bits = &bits[pitch * (bu ? hdr.height - y - height : y) + pf->size * x];
+	tile.rbits = NULL;
 	if(stereo && rbits)
-		f->rbits =
+		tile.rbits =
 			&rbits[pitch * (bu ? hdr.height - y - height : y) + pf->size * x];
-	return f;
+	tile.chroma[0] = tile.chroma[1] = NULL;
+	tile.chromaPitch = chromaPitch;
+	if(chroma[0])
+	{
+		if(x % 2 || y % 2)
+			throw Error("Frame::getTile", "Argument out of range");
+		for(int i = 0; i < 2; i++)
+			tile.chroma[i] = &chroma[i][chromaPitch * (y / 2) + x / 2];
+	}
+}
+
+
+// Returns true if the pixels in this frame can be compared with the pixels in
+// the given frame for the purposes of interframe comparison
+bool Frame::isComparable(Frame *last)
+{
+	return (last && hdr.width == last->hdr.width
+		&& hdr.height == last->hdr.height && hdr.framew == last->hdr.framew
+		&& hdr.frameh == last->hdr.frameh && hdr.qual == last->hdr.qual
+		&& hdr.subsamp == last->hdr.subsamp && pf->id == last->pf->id
+		&& pf->size == last->pf->size && hdr.winid == last->hdr.winid
+		&& hdr.dpynum == last->hdr.dpynum && !chroma[0] == !last->chroma[0]);
 }
 
 
-bool Frame::tileEquals(Frame *last, int x, int y, int width, int height)
+// If hash is non-NULL, then *hash should contain the fingerprint of the
+// corresponding tile in the last frame (or 0 if it is unknown), and it receives
+// the fingerprint of this tile.  If the fingerprint of the last frame's tile is
+// known, then the tiles are compared by fingerprint, which requires reading
+// only the pixels from this frame.  Note that a fingerprint collision will
+// cause a changed tile to be treated as unchanged.  Otherwise, the tiles are
+// compared row by row using memcmp(), which is already vectorized by the C
+// library.
+bool Frame::tileEquals(Frame *last, int x, int y, int width, int height,
+	unsigned long long *hash)
 {
 	bool bu = (flags & FRAME_BOTTOMUP);
 
@@ -152,11 +266,16 @@ bool Frame::tileEquals(Frame *last, int x, int y, int width, int height)
 		|| (y + height) > hdr.height)
 		throw Error("Frame::tileEquals", "Argument out of range");
 
-	if(last && hdr.width == last->hdr.width && hdr.height == last->hdr.height
-		&& hdr.framew == last->hdr.framew && hdr.frameh == last->hdr.frameh
-		&& hdr.qual == last->hdr.qual && hdr.subsamp == last->hdr.subsamp
-		&& pf->id == last->pf->id && pf->size == last->pf->size
-		&& hdr.winid == last->hdr.winid && hdr.dpynum == last->hdr.dpynum)
+	bool compatible = isComparable(last);
+
+	if(hash)
+	{
+		unsigned long long lastHash = *hash;
+		*hash = tileHash(x, y, width, height);
+		if(compatible && lastHash) return *hash == lastHash;
+	}
+
+	if(compatible)
 	{
 		if(bits && last->bits)
 		{
@@ -186,12 +305,319 @@ bool Frame::tileEquals(Frame *last, int x, int y, int width, int height)
 					return false;
 			}
 		}
+		if(chroma[0] && last->chroma[0])
+		{
+			for(int c = 0; c < 2; c++)
+			{
+				unsigned char *newBits =
+					&chroma[c][chromaPitch * (y / 2) + x / 2];
+				unsigned char *oldBits =
+					&last->chroma[c][last->chromaPitch * (y / 2) + x / 2];
+				for(int i = 0; i < (height + 1) / 2; i++)
+				{
+					if(memcmp(&newBits[chromaPitch * i],
+						&oldBits[last->chromaPitch * i], (width + 1) / 2))
+						return false;
+				}
+			}
+		}
 		return true;
 	}
 	return false;
 }
 
 
+// Shrink the specified tile to the bounding box of the pixels that differ from
+// the same tile in the last frame.  The bounding box is aligned to
+// DIRTY_ALIGN-pixel boundaries, relative to the tile origin.  Returns false if
+// no pixels differ.  If the frames cannot be compared at the pixel level, then
+// the tile is left unchanged.
+
+#define DIRTY_ALIGN  8
+
+// Compute the bounding box (in memory order) of the pixels that differ between
+// two planes, with the columns aligned to align-pixel boundaries.  Returns
+// false if no pixels differ.
+static bool planeBounds(unsigned char *newBits, int newPitch,
+	unsigned char *oldBits, int oldPitch, int ps, int width, int height,
+	int align, int &top, int &bottom, int &left, int &right)
+{
+	int i, j;
+
+	left = width;  right = -1;
+	for(top = 0; top < height; top++)
+		if(memcmp(&newBits[newPitch * top], &oldBits[oldPitch * top], ps * width))
+			break;
+	if(top >= height) return false;
+	for(bottom = height - 1; bottom > top; bottom--)
+		if(memcmp(&newBits[newPitch * bottom], &oldBits[oldPitch * bottom],
+			ps * width))
+			break;
+
+	for(i = top; i <= bottom; i++)
+	{
+		unsigned char *newRow = &newBits[newPitch * i],
+			*oldRow = &oldBits[oldPitch * i];
+
+		for(j = 0; j < left; j += align)
+		{
+			int w = min(align, width - j);
+			if(memcmp(&newRow[ps * j], &oldRow[ps * j], ps * w))
+			{
+				left = j;  break;
+			}
+		}
+		for(j = (width - 1) / align * align; j > right; j -= align)
+		{
+			int w = min(align, width - j);
+			if(memcmp(&newRow[ps * j], &oldRow[ps * j], ps * w))
+			{
+				right = j + w - 1;  break;
+			}
+		}
+	}
+	return true;
+}
+
+
+bool Frame::dirtyRect(Frame *last, int &x, int &y, int &width, int &height)
+{
+	bool bu = (flags & FRAME_BOTTOMUP), dirty;
+	int ps = pf->size, top, bottom, left, right;
+
+	if(x < 0 || y < 0 || width < 1 || height < 1 || (x + width) > hdr.width
+		|| (y + height) > hdr.height)
+		throw Error("Frame::dirtyRect", "Argument out of range");
+
+	if(!isComparable(last) || !bits || !last->bits || (stereo && rbits))
+		return true;
+
+	unsigned char *newBits =
+		&bits[pitch * (bu ? hdr.height - y - height : y) + ps * x];
+	unsigned char *oldBits =
+		&last->bits[last->pitch * (bu ? hdr.height - y - height : y) + ps * x];
+
+	// Rows are numbered in memory order here.
+	dirty = planeBounds(newBits, pitch, oldBits, last->pitch, ps, width, height,
+		DIRTY_ALIGN, top, bottom, left, right);
+
+	// The chrominance planes of a YUV frame can differ where the Y plane does
+	// not, so the bounding box must also include the chrominance differences.
+	if(chroma[0] && last->chroma[0])
+	{
+		for(int c = 0; c < 2; c++)
+		{
+			int ctop, cbottom, cleft, cright;
+
+			if(!planeBounds(&chroma[c][chromaPitch * (y / 2) + x / 2], chromaPitch,
+				&last->chroma[c][last->chromaPitch * (y / 2) + x / 2],
+				last->chromaPitch, 1, (width + 1) / 2, (height + 1) / 2,
+				DIRTY_ALIGN / 2, ctop, cbottom, cleft, cright))
+				continue;
+			ctop *= 2;  cbottom = min(cbottom * 2 + 1, height - 1);
+			cleft *= 2;  cright = min(cright * 2 + 1, width - 1);
+			if(!dirty)
+			{
+				top = ctop;  bottom = cbottom;  left = cleft;  right = cright;
+				dirty = true;
+			}
+			else
+			{
+				top = min(top, ctop);  bottom = max(bottom, cbottom);
+				left = min(left, cleft);  right = max(right, cright);
+			}
+		}
+	}
+	if(!dirty) return false;
+
+	if(bu)
+	{
+		int temp = top;
+		top = height - 1 - bottom;  bottom = height - 1 - temp;
+	}
+	top = top / DIRTY_ALIGN * DIRTY_ALIGN;
+	bottom = min((bottom / DIRTY_ALIGN + 1) * DIRTY_ALIGN, height) - 1;
+
+	x += left;  width = right - left + 1;
+	y += top;  height = bottom - top + 1;
+	return true;
+}
+
+
+// 64-bit tile fingerprint, based on the XXH3 accumulation loop.  Each row is
+// consumed in 64-byte stripes by eight independent accumulators using only
+// 32x32-bit multiplications.  The loop is implemented using SSE2 intrinsics if
+// SSE2 is available and in portable C otherwise.  Computing the fingerprint is
+// CPU-bound and is roughly three times slower than comparing a tile with
+// memcmp(), so fingerprinting is beneficial only if memory bandwidth, rather
+// than CPU time, is the bottleneck (see VGL_FINGERPRINT.)
+
+#define PRIME32_1  0x9E3779B1U
+#define PRIME64_2  0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3  0x165667B19E3779F9ULL
+#define PRIME64_4  0x85EBCA77C2B2AE63ULL
+
+static const unsigned long long hashKey[8] =
+{
+	0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL, 0xDB979083E96DD4DEULL,
+	0x1F67B3B7A4A44072ULL, 0x78E5C0CC4EE679CBULL, 0x2172FFCC7DD05A82ULL,
+	0x8E2443F7744608B8ULL, 0x4C263A81E69035E0ULL
+};
+
+#ifdef __SSE2__
+
+#define HASHSTRIPE128(acc, buf, j) \
+{ \
+	__m128i w = _mm_loadu_si128((const __m128i *)&(buf)[j * 16]); \
+	__m128i wk = _mm_xor_si128(w, key##j); \
+	__m128i product = _mm_mul_epu32(wk, \
+		_mm_shuffle_epi32(wk, _MM_SHUFFLE(0, 3, 0, 1))); \
+	acc = _mm_add_epi64(acc, _mm_shuffle_epi32(w, _MM_SHUFFLE(1, 0, 3, 2))); \
+	acc = _mm_add_epi64(acc, product); \
+}
+
+#define HASHSCRAMBLE128(acc, j) \
+{ \
+	acc = _mm_xor_si128(acc, _mm_srli_epi64(acc, 47)); \
+	acc = _mm_xor_si128(acc, key##j); \
+	__m128i lo = _mm_mul_epu32(acc, prime); \
+	__m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(acc, _MM_SHUFFLE(0, 3, 0, 1)), \
+		prime); \
+	acc = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)); \
+}
+
+static void hashRow(unsigned long long acc[8], const unsigned char *buf,
+	int len)
+{
+	const __m128i key0 = _mm_loadu_si128((const __m128i *)&hashKey[0]),
+		key1 = _mm_loadu_si128((const __m128i *)&hashKey[2]),
+		key2 = _mm_loadu_si128((const __m128i *)&hashKey[4]),
+		key3 = _mm_loadu_si128((const __m128i *)&hashKey[6]),
+		prime = _mm_set1_epi32((int)PRIME32_1);
+	__m128i acc0 = _mm_loadu_si128((const __m128i *)&acc[0]),
+		acc1 = _mm_loadu_si128((const __m128i *)&acc[2]),
+		acc2 = _mm_loadu_si128((const __m128i *)&acc[4]),
+		acc3 = _mm_loadu_si128((const __m128i *)&acc[6]);
+	int i = 0;
+
+	for(; i <= len - 64; i += 64)
+	{
+		HASHSTRIPE128(acc0, &buf[i], 0);
+		HASHSTRIPE128(acc1, &buf[i], 1);
+		HASHSTRIPE128(acc2, &buf[i], 2);
+		HASHSTRIPE128(acc3, &buf[i], 3);
+	}
+	if(i < len)
+	{
+		unsigned char tail[64];
+		memset(tail, 0, 64);
+		memcpy(tail, &buf[i], len - i);
+		HASHSTRIPE128(acc0, tail, 0);
+		HASHSTRIPE128(acc1, tail, 1);
+		HASHSTRIPE128(acc2, tail, 2);
+		HASHSTRIPE128(acc3, tail, 3);
+	}
+	// Scramble the accumulators after each row, so that the high bits of each
+	// accumulator are folded back in.
+	HASHSCRAMBLE128(acc0, 0);
+	HASHSCRAMBLE128(acc1, 1);
+	HASHSCRAMBLE128(acc2, 2);
+	HASHSCRAMBLE128(acc3, 3);
+	_mm_storeu_si128((__m128i *)&acc[0], acc0);
+	_mm_storeu_si128((__m128i *)&acc[2], acc1);
+	_mm_storeu_si128((__m128i *)&acc[4], acc2);
+	_mm_storeu_si128((__m128i *)&acc[6], acc3);
+}
+
+#else
+
+static inline void hashStripe(unsigned long long acc[8],
+	const unsigned char *buf)
+{
+	unsigned long long w[8];
+
+	memcpy(w, buf, 64);
+	for(int j = 0; j < 8; j++)
+	{
+		unsigned long long wk = w[j] ^ hashKey[j];
+		acc[j ^ 1] += w[j];
+		acc[j] += (wk & 0xFFFFFFFFULL) * (wk >> 32);
+	}
+}
+
+static void hashRow(unsigned long long acc[8], const unsigned char *buf,
+	int len)
+{
+	unsigned long long a[8];
+	int i = 0, j;
+
+	memcpy(a, acc, sizeof(a));
+	for(; i <= len - 64; i += 64) hashStripe(a, &buf[i]);
+	if(i < len)
+	{
+		unsigned char tail[64];
+		memset(tail, 0, 64);
+		memcpy(tail, &buf[i], len - i);
+		hashStripe(a, tail);
+	}
+	// Scramble the accumulators after each row, so that the high bits of each
+	// accumulator are folded back in.
+	for(j = 0; j < 8; j++)
+	{
+		a[j] ^= a[j] >> 47;  a[j] ^= hashKey[j];  a[j] *= PRIME32_1;
+	}
+	memcpy(acc, a, sizeof(a));
+}
+
+#endif
+
+
+unsigned long long Frame::tileHash(int x, int y, int width, int height)
+{
+	bool bu = (flags & FRAME_BOTTOMUP);
+	unsigned long long acc[8], h;
+	int rowSize = pf->size * width, i;
+
+	if(!bits || !pitch || !pf->size) THROW("Frame not initialized");
+	if(x < 0 || y < 0 || width < 1 || height < 1 || (x + width) > hdr.width
+		|| (y + height) > hdr.height)
+		throw Error("Frame::tileHash", "Argument out of range");
+
+	for(i = 0; i < 8; i++) acc[i] = hashKey[7 - i];
+	unsigned char *ptr =
+		&bits[pitch * (bu ? hdr.height - y - height : y) + pf->size * x];
+	for(i = 0; i < height; i++, ptr += pitch) hashRow(acc, ptr, rowSize);
+	if(stereo && rbits)
+	{
+		ptr = &rbits[pitch * (bu ? hdr.height - y - height : y) + pf->size * x];
+		for(i = 0; i < height; i++, ptr += pitch) hashRow(acc, ptr, rowSize);
+	}
+	if(chroma[0])
+	{
+		for(int c = 0; c < 2; c++)
+		{
+			ptr = &chroma[c][chromaPitch * (y / 2) + x / 2];
+			for(i = 0; i < (height + 1) / 2; i++, ptr += chromaPitch)
+				hashRow(acc, ptr, (width + 1) / 2);
+		}
+	}
+
+	h = (unsigned long long)rowSize * PRIME64_4 + (unsigned long long)height;
+	for(i = 0; i < 8; i += 2)
+	{
+		unsigned long long lo = acc[i] ^ hashKey[i],
+			hi = acc[i + 1] ^ hashKey[i + 1];
+		h += (lo & 0xFFFFFFFFULL) * (hi >> 32) + (hi & 0xFFFFFFFFULL) * (lo >> 32)
+			+ (lo ^ (hi << 7)) * PRIME64_2;
+	}
+	h ^= h >> 37;  h *= PRIME64_3;
+	h ^= h >> 32;
+
+	// 0 is reserved to mean "unknown"
+	return h ? h : 1;
+}
+
+
 void Frame::makeAnaglyph(Frame &r, Frame &g, Frame &b)
 {
 	int i, j;
@@ -400,11 +826,86 @@ void Frame::checkHeader(rrframeheader &h)
 }
 
 
+// Copy the planes of a YUV frame (or a tile of one) into a buffer with the
+// specified plane offsets and strides
+static void copyYUVPlanes(Frame &f, unsigned char *dst, const int *offsets,
+	const int *strides)
+{
+	unsigned char *src[3] = { f.bits, f.chroma[0], f.chroma[1] };
+	int srcStrides[3] = { f.pitch, f.chromaPitch, f.chromaPitch };
+
+	for(int c = 0; c < 3; c++)
+	{
+		int width = c ? (f.hdr.width + 1) / 2 : f.hdr.width;
+		int height = c ? (f.hdr.height + 1) / 2 : f.hdr.height;
+		for(int i = 0; i < height; i++)
+			memcpy(&dst[offsets[c] + strides[c] * i], &src[c][srcStrides[c] * i],
+				width);
+	}
+}
+
+
+// Reference-counted buffer
+
+SharedBuffer::~SharedBuffer(void)
+{
+	free(buf);  buf = NULL;
+}
+
+
+// Grow the buffer, preserving its contents.  This should be called only by the
+// holder of the sole reference to the buffer.
+void SharedBuffer::alloc(unsigned int newSize)
+{
+	if(newSize > size || !buf)
+	{
+		char *newBuf = (char *)realloc(buf, newSize);
+		if(!newBuf) THROW("Memory allocation error");
+		buf = newBuf;  size = newSize;
+	}
+}
+
+
+void SharedBuffer::addRef(void)
+{
+	CriticalSection::SafeLock l(mutex);
+	refs++;
+}
+
+
+void SharedBuffer::release(void)
+{
+	bool last;
+
+	mutex.lock();
+	last = (--refs == 0);
+	mutex.unlock();
+	if(last && pool) pool->add(this);
+}
+
+
 // Compressed frame
 
-CompressedFrame::CompressedFrame(void) : Frame(), tjhnd(NULL)
+// The TurboJPEG compressor instance is created the first time that a frame is
+// compressed, so a CompressedFrame that is used only to receive compressed
+// images does not need one.
+CompressedFrame::CompressedFrame(void) : Frame(), allocs(0), tjhnd(NULL),
+	ownHandle(true), bufSize(0), rbufSize(0)
+{
+	shared[0] = shared[1] = NULL;
+	pf = pf_get(PF_RGB);
+	memset(&rhdr, 0, sizeof(rrframeheader));
+}
+
+
+// Use the specified TurboJPEG compressor instance, which must remain valid for
+// the lifetime of this object and must not be used by another thread while this
+// object is compressing a frame
+CompressedFrame::CompressedFrame(tjhandle tjhnd_) : Frame(), allocs(0),
+	tjhnd(tjhnd_), ownHandle(false), bufSize(0), rbufSize(0)
 {
-	if(!(tjhnd = tjInitCompress())) THROW(tjGetErrorStr());
+	if(!tjhnd) THROW("Invalid argument");
+	shared[0] = shared[1] = NULL;
 	pf = pf_get(PF_RGB);
 	memset(&rhdr, 0, sizeof(rrframeheader));
 }
@@ -412,14 +913,15 @@ CompressedFrame::CompressedFrame(void) : Frame(), tjhnd(NULL)
 
 CompressedFrame::~CompressedFrame(void)
 {
-	if(tjhnd) tjDestroy(tjhnd);
+	releaseShared();
+	if(tjhnd && ownHandle) tjDestroy(tjhnd);
 }
 
 CompressedFrame &CompressedFrame::operator= (Frame &f)
 {
 	if(!f.bits) THROW("Frame not initialized");
-	if(f.pf->size < 3 || f.pf->size > 4)
-		THROW("Only true color frames are supported");
+	if(!f.chroma[0] && (f.pf->size < 3 || f.pf->size > 4))
+		THROW("Only true color and YUV frames are supported");
 
 	switch(f.hdr.compress)
 	{
@@ -441,6 +943,18 @@ void CompressedFrame::compressYUV(Frame &f)
 		throw(Error("YUV encoder", "YUV encoding requires 8 bits per component"));
 
 	init(f.hdr, 0);
+	if(f.chroma[0])
+	{
+		// The frame is already YUV, so it only needs to be repacked.
+		int chromaw = (f.hdr.width + 1) / 2, chromah = (f.hdr.height + 1) / 2;
+		int strides[3] = { PAD(f.hdr.width, 4), PAD(chromaw, 4), PAD(chromaw, 4) };
+		int offsets[3] = { 0, strides[0] * f.hdr.height,
+			strides[0] * f.hdr.height + strides[1] * chromah };
+		copyYUVPlanes(f, bits, offsets, strides);
+		hdr.size = offsets[2] + strides[2] * chromah;
+		return;
+	}
+	if(!tjhnd && !(tjhnd = tjInitCompress())) THROW(tjGetErrorStr());
 	if(f.flags & FRAME_BOTTOMUP) tjflags |= TJ_BOTTOMUP;
 	TRY_TJ(tjEncodeYUV2(tjhnd, f.bits, f.hdr.width, f.pitch, f.hdr.height,
 		tjpf[f.pf->id], bits, TJSUBSAMP(f.hdr.subsamp), tjflags));
@@ -460,8 +974,20 @@ void CompressedFrame::compressJPEG(Frame &f)
 			"JPEG compression requires 8 bits per component"));
 
 	init(f.hdr, f.stereo ? RR_LEFT : 0);
+	if(!tjhnd && !(tjhnd = tjInitCompress())) THROW(tjGetErrorStr());
 	if(f.flags & FRAME_BOTTOMUP) tjflags |= TJ_BOTTOMUP;
 	unsigned long size;
+	if(f.chroma[0])
+	{
+		// YUV frames are always 4:2:0, so they are compressed without color
+		// conversion or downsampling.
+		const unsigned char *planes[3] = { f.bits, f.chroma[0], f.chroma[1] };
+		int strides[3] = { f.pitch, f.chromaPitch, f.chromaPitch };
+		TRY_TJ(tjCompressFromYUVPlanes(tjhnd, planes, f.hdr.width, strides,
+			f.hdr.height, TJSAMP_420, &bits, &size, f.hdr.qual, TJFLAG_NOREALLOC));
+		hdr.size = (unsigned int)size;
+		return;
+	}
 	TRY_TJ(tjCompress2(tjhnd, f.bits, f.hdr.width, f.pitch, f.hdr.height,
 		tjpf[f.pf->id], &bits, &size, TJSUBSAMP(f.hdr.subsamp), f.hdr.qual,
 		tjflags | TJFLAG_NOREALLOC));
@@ -509,43 +1035,107 @@ void CompressedFrame::compressRGB(Frame &f)
 }
 
 
-void CompressedFrame::init(rrframeheader &h, int buffer)
+// The compressed image buffers are reallocated only if they need to grow, so a
+// CompressedFrame that is reused for tiles of varying sizes stops allocating
+// memory once its buffers are large enough to hold the largest tile.  size
+// specifies the required buffer size (for instance, the size of a compressed
+// image that is about to be received.)  If size is 0, then the buffers are
+// sized for the worst case (4:4:4 JPEG) for the tile dimensions, which is also
+// large enough to hold an RGB- or YUV-encoded image.
+void CompressedFrame::init(rrframeheader &h, int buffer, unsigned long size)
 {
 	checkHeader(h);
 	if(h.flags == RR_EOF) { hdr = h;  return; }
-	switch(buffer)
+	if(size == 0)
 	{
-		case RR_LEFT:
-			if(h.width != hdr.width || h.height != hdr.height || !bits)
-			{
-				delete [] bits;
-				NEWCHECK(bits = new unsigned char[tjBufSize(h.width, h.height,
-					h.subsamp)]);
-			}
-			hdr = h;  hdr.flags = RR_LEFT;  stereo = true;
-			break;
-		case RR_RIGHT:
-			if(h.width != rhdr.width || h.height != rhdr.height || !rbits)
-			{
-				delete [] rbits;
-				NEWCHECK(rbits = new unsigned char[tjBufSize(h.width, h.height,
-					h.subsamp)]);
-			}
-			rhdr = h;  rhdr.flags = RR_RIGHT;  stereo = true;
-			break;
-		default:
-			if(h.width != hdr.width || h.height != hdr.height || !bits)
-			{
-				delete [] bits;
-				NEWCHECK(bits = new unsigned char[tjBufSize(h.width, h.height,
-					h.subsamp)]);
-			}
-			hdr = h;  hdr.flags = 0;  stereo = false;
-			break;
+		size = tjBufSize(h.width, h.height, TJSAMP_444);
+		if(size == (unsigned long)-1) THROW(tjGetErrorStr());
+	}
+	if(buffer == RR_RIGHT)
+	{
+		if(size > rbufSize || !rbits)
+		{
+			freeBuffer(RR_RIGHT);
+			NEWCHECK(rbits = new unsigned char[size]);
+			rbufSize = size;  allocs++;
+		}
+	}
+	else if(size > bufSize || !bits)
+	{
+		freeBuffer(buffer);
+		NEWCHECK(bits = new unsigned char[size]);
+		bufSize = size;  allocs++;
+	}
+	setHeader(h, buffer);
+}
+
+
+// Use a compressed image (h.size bytes starting at bits_) that is stored in a
+// shared buffer, rather than copying it into one of this frame's own buffers.
+// The frame holds a reference to the shared buffer until releaseShared() is
+// called, so the image must not be modified until then.
+void CompressedFrame::initExternal(rrframeheader &h, int buffer,
+	unsigned char *bits_, SharedBuffer *sb)
+{
+	checkHeader(h);
+	if(h.flags == RR_EOF || !bits_ || !sb)
+		throw(Error("CompressedFrame::initExternal", "Invalid argument"));
+	int eye = (buffer == RR_RIGHT);
+	freeBuffer(buffer);
+	sb->addRef();  shared[eye] = sb;
+	if(eye) rbits = bits_;
+	else bits = bits_;
+	setHeader(h, buffer);
+}
+
+
+// Release the references to any shared buffers that hold this frame's
+// compressed images.  This is called once the images have been decompressed.
+void CompressedFrame::releaseShared(void)
+{
+	if(shared[0]) freeBuffer(0);
+	if(shared[1]) freeBuffer(RR_RIGHT);
+}
+
+
+// Free the left or right eye buffer, or release it if it is shared
+void CompressedFrame::freeBuffer(int buffer)
+{
+	int eye = (buffer == RR_RIGHT);
+	unsigned char *&buf = eye ? rbits : bits;
+
+	if(shared[eye])
+	{
+		shared[eye]->release();  shared[eye] = NULL;
+	}
+	else delete [] buf;
+	buf = NULL;
+	if(eye) rbufSize = 0;
+	else bufSize = 0;
+}
+
+
+void CompressedFrame::setHeader(rrframeheader &h, int buffer)
+{
+	if(buffer == RR_RIGHT)
+	{
+		rhdr = h;  rhdr.flags = RR_RIGHT;  stereo = true;
+	}
+	else
+	{
+		hdr = h;
+		if(buffer == RR_LEFT)
+		{
+			hdr.flags = RR_LEFT;  stereo = true;
+		}
+		else
+		{
+			hdr.flags = 0;  stereo = false;
+		}
 	}
 	if(!stereo && rbits)
 	{
-		delete [] rbits;  rbits = NULL;
+		freeBuffer(RR_RIGHT);
 		memset(&rhdr, 0, sizeof(rrframeheader));
 	}
 	pitch = hdr.width * pf->size;
@@ -576,7 +1166,7 @@ FBXFrame::FBXFrame(char *dpystring, Window win) : Frame()
 
 void FBXFrame::init(char *dpystring, Drawable draw, Visual *vis)
 {
-	tjhnd = NULL;  reuseConn = false;
+	tjhnd = NULL;  reuseConn = false;  selectedExpose = false;
 	memset(&fb, 0, sizeof(fbx_struct));
 
 	if(!dpystring || !draw) throw(Error("FBXFrame::init", "Invalid argument"));
@@ -590,7 +1180,7 @@ void FBXFrame::init(char *dpystring, Drawable draw, Visual *vis)
 
 void FBXFrame::init(Display *dpy, Drawable draw, Visual *vis)
 {
-	tjhnd = NULL;  reuseConn = true;
+	tjhnd = NULL;  reuseConn = true;  selectedExpose = false;
 	memset(&fb, 0, sizeof(fbx_struct));
 
 	if(!dpy || !draw) throw(Error("FBXFrame::init", "Invalid argument"));
@@ -636,12 +1226,30 @@ void FBXFrame::init(rrframeheader &h)
 
 
 FBXFrame &FBXFrame::operator= (CompressedFrame &cf)
+{
+	if(!cf.bits || cf.hdr.size < 1)
+		THROW("JPEG not initialized");
+	init(cf.hdr);
+	if(cf.hdr.compress != RRCOMP_RGB && !tjhnd)
+	{
+		if((tjhnd = tjInitDecompress()) == NULL)
+			throw(Error("FBXFrame::decompressor", tjGetErrorStr()));
+	}
+	decompressTile(cf, tjhnd);
+	return *this;
+}
+
+
+// Decompress a tile into this frame without reinitializing the frame.  The
+// frame must already have been initialized using the tile's header.  Tiles
+// occupy disjoint regions of the frame, so multiple threads can call this
+// method simultaneously (using different TurboJPEG instances.)
+void FBXFrame::decompressTile(CompressedFrame &cf, tjhandle tjhnd)
 {
 	int tjflags = 0;
 
 	if(!cf.bits || cf.hdr.size < 1)
 		THROW("JPEG not initialized");
-	init(cf.hdr);
 	if(!fb.xi) THROW("Frame not initialized");
 
 	int width = min(cf.hdr.width, fb.width - cf.hdr.x);
@@ -655,17 +1263,12 @@ FBXFrame &FBXFrame::operator= (CompressedFrame &cf)
 			if(pf->bpc != 8)
 				throw(Error("JPEG decompressor",
 					"JPEG decompression requires 8 bits per component"));
-			if(!tjhnd)
-			{
-				if((tjhnd = tjInitDecompress()) == NULL)
-					throw(Error("FBXFrame::decompressor", tjGetErrorStr()));
-			}
+			if(!tjhnd) THROW("Invalid argument");
 			TRY_TJ(tjDecompress2(tjhnd, cf.bits, cf.hdr.size,
 				(unsigned char *)&fb.bits[fb.pitch * cf.hdr.y + cf.hdr.x * pf->size],
 				width, fb.pitch, height, tjpf[pf->id], tjflags));
 		}
 	}
-	return *this;
 }
 
 
@@ -676,6 +1279,43 @@ void FBXFrame::redraw(void)
 }
 
 
+// Draw a region of the frame without waiting for the X server to finish
+// drawing it.  sync() must be called after the last region is drawn.
+void FBXFrame::drawTile(int x, int y, int width, int height)
+{
+	if(x < 0 || width < 1 || (x + width) > fb.width || y < 0 || height < 1
+		|| (y + height) > fb.height)
+		return;
+	TRY_FBX(fbx_awrite(&fb, x, y, x, y, width, height));
+}
+
+
+void FBXFrame::sync(void)
+{
+	TRY_FBX(fbx_sync(&fb));
+}
+
+
+// Returns true if any part of the window has been exposed since the last time
+// this method was called (or if it has never been called), in which case the
+// whole frame should be redrawn.  Exposure events can only be received if this
+// frame has its own display connection.
+bool FBXFrame::exposed(void)
+{
+	XEvent e;  bool ret = false;
+
+	if(reuseConn) return false;
+	if(!selectedExpose)
+	{
+		XSelectInput(wh.dpy, wh.d, ExposureMask);
+		selectedExpose = true;
+		return true;
+	}
+	while(XCheckTypedWindowEvent(wh.dpy, wh.d, Expose, &e)) ret = true;
+	return ret;
+}
+
+
 #ifdef USEXV
 
 // Frame created using X Video
@@ -724,6 +1364,15 @@ XVFrame::~XVFrame(void)
 XVFrame &XVFrame::operator= (Frame &f)
 {
 	if(!f.bits) THROW("Frame not initialized");
+	if(f.chroma[0])
+	{
+		init(f.hdr);
+		if(hdr.framew < f.hdr.width || hdr.frameh < f.hdr.height)
+			THROW("Image size mismatch in YUV encoder");
+		copyYUVPlanes(f, bits, fb.xvi->offsets, fb.xvi->pitches);
+		hdr.size = fb.xvi->data_size;
+		return *this;
+	}
 	if(f.pf->bpc != 8)
 		throw(Error("YUV encoder", "YUV encoding requires 8 bits per component"));
 
@@ -19,6 +19,7 @@
 #include "fbx.h"
 #include "turbojpeg.h"
 #include "Mutex.h"
+#include "GenericQ.h"
 #ifdef USEXV
 #include "fbxv.h"
 #endif
@@ -43,9 +44,16 @@ namespace vglcommon
 				bool stereo = false);
 			void init(unsigned char *bits, int width, int pitch, int height,
 				int pixelFormat, int flags);
+			void initExternal(rrframeheader &h, int pixelFormat, int flags,
+				unsigned char *bits, int pitch);
+			void initYUV(rrframeheader &h);
 			void deInit(void);
 			Frame *getTile(int x, int y, int width, int height);
-			bool tileEquals(Frame *last, int x, int y, int width, int height);
+			void getTile(Frame &tile, int x, int y, int width, int height);
+			bool tileEquals(Frame *last, int x, int y, int width, int height,
+				unsigned long long *hash = NULL);
+			unsigned long long tileHash(int x, int y, int width, int height);
+			bool dirtyRect(Frame *last, int &x, int &y, int &width, int &height);
 			void makeAnaglyph(Frame &r, Frame &g, Frame &b);
 			void makePassive(Frame &stf, int mode);
 			void signalReady(void) { ready.signal(); }
@@ -60,6 +68,10 @@ namespace vglcommon
 			unsigned char *bits;
 			unsigned char *rbits;
 			int pitch, flags;
+			// U and V planes of a planar YUV 4:2:0 frame (see initYUV()), or NULL.
+			// bits points to the Y plane.
+			unsigned char *chroma[2];
+			int chromaPitch;
 			PF *pf;
 			bool isGL, isXV, stereo;
 
@@ -67,11 +79,43 @@ namespace vglcommon
 
 			void dumpHeader(rrframeheader &);
 			void checkHeader(rrframeheader &);
+			bool isComparable(Frame *last);
 
 			vglutil::Event ready;
 			vglutil::Event complete;
 			friend class CompressedFrame;
 			bool primary;
+			// bits is owned by the caller of initExternal() (primary frames only)
+			bool external;
+	};
+}
+
+
+// Reference-counted buffer that holds the compressed images for one or more
+// CompressedFrames (see CompressedFrame::initExternal().)  The buffer is
+// returned to its pool once the last reference to it has been released.
+
+namespace vglcommon
+{
+	class SharedBuffer
+	{
+		public:
+
+			SharedBuffer(vglutil::GenericQ *pool_) : buf(NULL), size(0), refs(0),
+				pool(pool_) {}
+			~SharedBuffer(void);
+			void alloc(unsigned int newSize);
+			void addRef(void);
+			void release(void);
+
+			char *buf;
+			unsigned int size;
+
+		private:
+
+			int refs;
+			vglutil::CriticalSection mutex;
+			vglutil::GenericQ *pool;
 	};
 }
 
@@ -85,18 +129,32 @@ namespace vglcommon
 		public:
 
 			CompressedFrame(void);
+			CompressedFrame(tjhandle tjhnd);
 			~CompressedFrame(void);
 			CompressedFrame &operator= (Frame &f);
 			void compressYUV(Frame &f);
 			void compressJPEG(Frame &f);
 			void compressRGB(Frame &f);
-			void init(rrframeheader &h, int buffer);
+			void init(rrframeheader &h, int buffer, unsigned long size = 0);
+			void initExternal(rrframeheader &h, int buffer, unsigned char *bits,
+				SharedBuffer *sb);
+			void releaseShared(void);
 
 			rrframeheader rhdr;
+			// Number of times that the compressed image buffers have been allocated
+			long allocs;
 
 		private:
 
+			void freeBuffer(int buffer);
+			void setHeader(rrframeheader &h, int buffer);
+
 			tjhandle tjhnd;
+			bool ownHandle;
+			unsigned long bufSize, rbufSize;
+			// Shared buffers that hold the left and right eye images, if they were
+			// initialized using initExternal()
+			SharedBuffer *shared[2];
 			friend class FBXFrame;
 	};
 }
@@ -118,14 +176,18 @@ namespace vglcommon
 			~FBXFrame(void);
 			void init(rrframeheader &h);
 			FBXFrame &operator= (CompressedFrame &cf);
+			void decompressTile(CompressedFrame &cf, tjhandle tjhnd);
 			void redraw(void);
+			void drawTile(int x, int y, int width, int height);
+			void sync(void);
+			bool exposed(void);
 
 		private:
 
 			fbx_wh wh;
 			fbx_struct fb;
 			tjhandle tjhnd;
-			bool reuseConn;
+			bool reuseConn, selectedExpose;
 			static vglutil::CriticalSection mutex;
 	};
 }
@@ -27,7 +27,8 @@ using namespace vglcommon;
 
 Profiler::Profiler(const char *name_, double interval_) : interval(interval_),
 	mbytes(0.0), mpixels(0.0), totalTime(0.0), start(0.0), frames(0),
-	lastFrame(0.0)
+	lastFrame(0.0), allocs(0), queueDepth(0), queueSamples(0),
+	countAllocs(false), hist(NULL)
 {
 	profile = false;  char *ev = NULL;
 	setName(name_);  freestr = false;
@@ -61,15 +62,20 @@ void Profiler::setName(const char *name_)
 
 void Profiler::startFrame(void)
 {
-	if(!profile) return;
+	if(!profile && !hist) return;
 	start = timer.time();
 }
 
 
+// If a histogram has been specified (see setHistogram()), then the time
+// between startFrame() and endFrame() is recorded in it, regardless of whether
+// profiling is enabled.
 void Profiler::endFrame(long pixels, long bytes, double incFrames)
 {
-	if(!profile) return;
+	if(!profile && !hist) return;
 	double now = timer.time();
+	if(hist && start != 0.0) hist->add(now - start);
+	if(!profile) { start = 0.0;  return; }
 	if(start != 0.0)
 	{
 		totalTime += now - start;
@@ -98,8 +104,106 @@ void Profiler::endFrame(long pixels, long bytes, double incFrames)
 				mbytes * 8.0 / totalTime, mpixels * 3. / mbytes);
 			i = strlen(temps);
 		}
+		if(countAllocs)
+		{
+			snprintf(&temps[i], 255 - i, "- %ld allocs", allocs);
+			i = strlen(temps);
+		}
+		if(queueSamples)
+		{
+			snprintf(&temps[i], 255 - i, "- %.1f queued",
+				(double)queueDepth / (double)queueSamples);
+			i = strlen(temps);
+		}
 		vglout.PRINT("%s\n", temps);
-		totalTime = 0.;  mpixels = 0.;  frames = 0.;  mbytes = 0.;
+		totalTime = 0.;  mpixels = 0.;  frames = 0.;  mbytes = 0.;  allocs = 0;
+		queueDepth = 0;  queueSamples = 0;
 		lastFrame = now;
 	}
 }
+
+
+// Record the number of heap allocations that occurred while processing the
+// current frame.  Once this has been called, the number of allocations during
+// each profiling interval is included in the profiling output.
+void Profiler::addAllocs(long allocs_)
+{
+	if(!profile) return;
+	countAllocs = true;
+	allocs += allocs_;
+}
+
+
+// Record the number of items waiting in the queue that feeds this stage of the
+// pipeline.  The average queue depth during each profiling interval is included
+// in the profiling output.
+void Profiler::addQueueDepth(int depth)
+{
+	if(!profile) return;
+	queueDepth += depth;  queueSamples++;
+}
+
+
+void Histogram::clear(void)
+{
+	memset(buckets, 0, sizeof(buckets));
+	total = 0;  maxValue = 0.0;
+}
+
+
+void Histogram::add(double seconds)
+{
+	unsigned long long usec = seconds > 0.0 ?
+		(unsigned long long)(seconds * 1000000.0) : 0;
+	int index = (int)usec;
+
+	if(usec >= 8)
+	{
+		int e = 3;
+		while(e < 63 && (usec >> (e + 1)) != 0) e++;
+		index = 8 + (e - 3) * 8 + (int)((usec >> (e - 3)) & 7);
+		if(index >= NBUCKETS) index = NBUCKETS - 1;
+	}
+
+	vglutil::CriticalSection::SafeLock l(mutex);
+	buckets[index]++;  total++;
+	if(seconds > maxValue) maxValue = seconds;
+}
+
+
+// Copy the contents of this histogram into dst (which must not be shared with
+// other threads), optionally resetting this histogram
+void Histogram::snapshot(Histogram &dst, bool reset)
+{
+	vglutil::CriticalSection::SafeLock l(mutex);
+	memcpy(dst.buckets, buckets, sizeof(buckets));
+	dst.total = total;  dst.maxValue = maxValue;
+	if(reset) clear();
+}
+
+
+// Return the pth percentile (0.0 < p <= 1.0), in seconds, or 0 if the
+// histogram is empty.  The midpoint of the bucket containing the percentile is
+// returned.  The histogram must not be shared with other threads.
+double Histogram::percentile(double p)
+{
+	unsigned long rank = (unsigned long)(p * (double)total + 0.999999), n = 0;
+	int i;
+
+	if(total == 0) return 0.0;
+	if(rank < 1) rank = 1;
+	for(i = 0; i < NBUCKETS - 1; i++)
+	{
+		n += buckets[i];
+		if(n >= rank) break;
+	}
+	double value;
+	if(i < 8) value = ((double)i + 0.5) / 1000000.0;
+	else
+	{
+		int e = (i - 8) / 8 + 3, sub = (i - 8) % 8;
+		double width = (double)(1ULL << (e - 3));
+		value = ((double)(8 + sub) * width + width / 2.0) / 1000000.0;
+	}
+	return value < maxValue ? value : maxValue;
+}
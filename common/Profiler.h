@@ -16,10 +16,35 @@
 #define __PROFILER_H__
 
 #include "Timer.h"
+#include "Mutex.h"
 
 
 namespace vglcommon
 {
+	// Thread-safe histogram of latencies (in seconds.)  The buckets are
+	// log-linear, with 8 buckets per power of two microseconds, so each
+	// percentile is accurate to within 1/16 of its value.
+	class Histogram
+	{
+		public:
+
+			Histogram(void) { clear(); }
+			void add(double seconds);
+			void snapshot(Histogram &dst, bool reset);
+			unsigned long count(void) { return total; }
+			double percentile(double p);
+			double maximum(void) { return maxValue; }
+
+		private:
+
+			void clear(void);
+
+			static const int NBUCKETS = 280;
+			unsigned long buckets[NBUCKETS], total;
+			double maxValue;
+			vglutil::CriticalSection mutex;
+	};
+
 	class Profiler
 	{
 		public:
@@ -28,17 +53,22 @@ namespace vglcommon
 			~Profiler(void);
 			void setName(char *name);
 			void setName(const char *name);
+			void setHistogram(Histogram *hist_) { hist = hist_; }
 			void startFrame(void);
 			void endFrame(long pixels, long bytes, double incFrames);
+			void addAllocs(long allocs);
+			void addQueueDepth(int depth);
 
 		private:
 
 			char *name;
 			double interval;
 			double mbytes, mpixels, totalTime, start, frames, lastFrame;
-			bool profile;
+			long allocs, queueDepth, queueSamples;
+			bool profile, countAllocs;
 			vglutil::Timer timer;
 			bool freestr;
+			Histogram *hist;
 	};
 }
 
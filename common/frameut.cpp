@@ -33,8 +33,8 @@ using namespace vglcommon;
 #define BORDER  0
 #define NUMWIN  1
 
-bool useGL = false, useXV = false, doRgbBench = false, useRGB = false,
-	addLogo = false, anaglyph = false, check = false;
+bool useGL = false, useXV = false, doRgbBench = false, doCmpBench = false,
+	useRGB = false, addLogo = false, anaglyph = false, check = false;
 
 
 void resizeWindow(Display *dpy, Window win, int width, int height, int myID)
@@ -597,6 +597,85 @@ void rgbBench(char *filename)
 }
 
 
+#define CMPW  3840
+#define CMPH  2160
+#define CMPTILE  256
+
+// Compare the throughput of interframe comparison using memcmp() with that of
+// interframe comparison using tile fingerprints, for a frame that has not
+// changed and a frame in which every tile has changed.
+void cmpBench(void)
+{
+	Frame src, dst;  rrframeheader hdr;
+	int i, x, y, nTiles = 0, modified;
+	unsigned long long *hashes = NULL;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.width = hdr.framew = CMPW;
+	hdr.height = hdr.frameh = CMPH;
+	src.init(hdr, PF_BGRX, 0);
+	dst.init(hdr, PF_BGRX, 0);
+	srand(0);
+	for(i = 0; i < src.pitch * CMPH; i++) src.bits[i] = rand() & 255;
+	NEWCHECK(hashes = new unsigned long long[((CMPW + CMPTILE - 1) / CMPTILE) *
+		((CMPH + CMPTILE - 1) / CMPTILE)]);
+
+	for(modified = 0; modified < 2; modified++)
+	{
+		memcpy(dst.bits, src.bits, src.pitch * CMPH);
+		if(modified)
+		{
+			for(y = 0; y < CMPH; y += CMPTILE)
+				for(x = 0; x < CMPW; x += CMPTILE)
+				{
+					int lastY = min(y + CMPTILE, CMPH) - 1;
+					int lastX = min(x + CMPTILE, CMPW) - 1;
+					dst.bits[dst.pitch * lastY + lastX * dst.pf->size] ^= 1;
+				}
+		}
+		fprintf(stderr, "%d x %d %s, %d x %d tiles:\n", CMPW, CMPH,
+			modified ? "modified" : "unmodified", CMPTILE, CMPTILE);
+
+		for(int useHash = 0; useHash < 2; useHash++)
+		{
+			double tStart, tTotal = 0.;  int iter = 0;  bool failed = false;
+			do
+			{
+				// Fingerprinting the source frame is not timed, since the
+				// fingerprints are normally carried over from the previous frame.
+				nTiles = 0;
+				if(useHash)
+				{
+					for(y = 0; y < CMPH; y += CMPTILE)
+						for(x = 0; x < CMPW; x += CMPTILE)
+							hashes[nTiles++] = src.tileHash(x, y,
+								min(CMPTILE, CMPW - x), min(CMPTILE, CMPH - y));
+				}
+				nTiles = 0;
+				tStart = GetTime();
+				for(y = 0; y < CMPH; y += CMPTILE)
+					for(x = 0; x < CMPW; x += CMPTILE)
+					{
+						if(dst.tileEquals(&src, x, y, min(CMPTILE, CMPW - x),
+							min(CMPTILE, CMPH - y), useHash ? &hashes[nTiles] : NULL)
+							== (bool)modified)
+							failed = true;
+						nTiles++;
+					}
+				tTotal += GetTime() - tStart;  iter++;
+			} while(tTotal < 1.);
+			fprintf(stderr, "  %-11s: %f Mpixels/sec - ",
+				useHash ? "fingerprint" : "memcmp()",
+				(double)CMPW * (double)CMPH * (double)iter / 1000000. / tTotal);
+			if(failed) fprintf(stderr, "FAILED!\n");
+			else fprintf(stderr, "Passed.\n");
+		}
+	}
+
+	delete [] hashes;
+}
+
+
 void usage(char **argv)
 {
 	fprintf(stderr, "\nUSAGE: %s [options]\n\n", argv[0]);
@@ -608,6 +687,7 @@ void usage(char **argv)
 	fprintf(stderr, "-anaglyph = Test anaglyph creation\n");
 	fprintf(stderr, "-rgbbench <filename> = Benchmark the decoding of RGB-encoded frames.\n");
 	fprintf(stderr, "                       <filename> should be a BMP or PPM file.\n");
+	fprintf(stderr, "-cmpbench = Benchmark interframe comparison (memcmp() vs. tile fingerprints)\n");
 	fprintf(stderr, "-v = Verbose output (may affect benchmark results)\n");
 	fprintf(stderr, "-check = Check correctness of pixel paths (implies -rgb)\n\n");
 	exit(1);
@@ -648,6 +728,7 @@ int main(int argc, char **argv)
 		{
 			fileName = argv[++i];  doRgbBench = true;
 		}
+		else if(!stricmp(argv[i], "-cmpbench")) doCmpBench = true;
 		else if(!stricmp(argv[i], "-v")) verbose = true;
 		else if(!stricmp(argv[i], "-check")) { check = true;  useRGB = true; }
 		else usage(argv);
@@ -656,6 +737,7 @@ int main(int argc, char **argv)
 	try
 	{
 		if(doRgbBench) { rgbBench(fileName);  exit(0); }
+		if(doCmpBench) { cmpBench();  exit(0); }
 
 		ERRIFNOT(XInitThreads());
 		if(!(dpy = XOpenDisplay(0)))
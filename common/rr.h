@@ -17,7 +17,7 @@
 #define __RR_H
 
 #define RR_MAJOR_VERSION  2
-#define RR_MINOR_VERSION  1
+#define RR_MINOR_VERSION  2
 
 /* Argh! */
 #if !defined(__SUNPRO_CC) && !defined(__SUNPRO_C)
@@ -49,6 +49,24 @@ typedef struct _rrframeheader
 } rrframeheader;
 #define sizeof_rrframeheader  26
 
+/* Header that precedes each batch of tiles in version 2.2 and later of the
+   VirtualGL protocol.  It is followed by an index of the tiles in the batch (an
+   array of rrframeheader structures) and then by the compressed images for all
+   of the tiles, in the same order as the index.  A frame may be sent as any
+   number of batches, but a batch contains tiles from only one frame, so an
+   End-of-Frame marker can only be the last entry in the index. */
+typedef struct _rrbatchheader
+{
+  unsigned int size;       /* The total size (in bytes) of the index and the
+                              compressed images that follow this header */
+  unsigned int tiles;      /* The number of entries in the index, including
+                              the End-of-Frame marker, if any */
+} rrbatchheader;
+#define sizeof_rrbatchheader  8
+
+/* The maximum number of entries in the index of a batch */
+#define RR_MAXBATCHTILES  1024
+
 typedef struct _rrversion
 {
   char id[3];
@@ -106,8 +124,12 @@ enum rrcomp
 };
 
 /* Readback types */
-#define RR_READBACKOPT  3
-enum rrread { RRREAD_NONE = 0, RRREAD_SYNC, RRREAD_PBO };
+#define RR_READBACKOPT  6
+enum rrread
+{
+  RRREAD_NONE = 0, RRREAD_SYNC, RRREAD_PBO, RRREAD_ASYNC, RRREAD_MAP,
+  RRREAD_DIFF
+};
 
 static const enum rrtrans _Trans[RR_COMPRESSOPT] =
 {
@@ -151,10 +173,6 @@ enum rrdrawable { RRDRAWABLE_PBUFFER = 0, RRDRAWABLE_PIXMAP };
 #endif
 #define RR_DEFAULTTILESIZE  256
 
-/* Maximum threads that be can be used for parallel image compression */
-/* (the algorithms don't scale beyond 3) */
-#define MAXPROCS  4
-
 #define MAXSTR  256
 
 /* Faker configuration */
@@ -173,7 +191,8 @@ typedef struct _FakerConfig
   double fps;
   double gamma;
   unsigned char gamma_lut[256];
-  unsigned short gamma_lut10[1024], gamma_lut16[65536];
+  unsigned int gamma_lut10[1024];
+  unsigned short gamma_lut16[65536];
   char glflushtrigger;
   char gllib[MAXSTR];
   char glxvendor[MAXSTR];
@@ -215,6 +234,11 @@ typedef struct _FakerConfig
   char xcbx11lib[MAXSTR];
   char excludeddpys[MAXSTR];
   char ocllib[MAXSTR];
+  char adaptivetiles;
+  int refine;
+  int refinequal;
+  char gpuyuv;
+  char fingerprint;
 } FakerConfig;
 
 #if !defined(__SUNPRO_CC) && !defined(__SUNPRO_C)
@@ -33,17 +33,22 @@ namespace vglutil
 			void add(void *item);
 			void spoil(void *item, SpoilCallback spoilCallback);
 			void get(void **item, bool nonBlocking = false);
+			void timedGet(void **item, double timeout);
 			void release(void);
 			int items(void);
 
 		private:
 
+			void remove(void **item);
+
 			typedef struct EntryStruct
 			{
 				void *item;  struct EntryStruct *next;
 			} Entry;
 
-			Entry *start, *end;
+			// Entries that have been removed from the queue are recycled, so a queue
+			// that is in constant use does not allocate memory.
+			Entry *start, *end, *freeList;
 			Semaphore hasItem;
 			CriticalSection mutex;
 			int deadYet;
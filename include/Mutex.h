@@ -92,6 +92,7 @@ namespace vglutil
 			~Semaphore(void);
 			void wait(void);
 			bool tryWait();
+			bool timedWait(double timeout);
 			void post(void);
 			long getValue(void);
 
@@ -136,6 +136,13 @@ typedef int SOCKET;
 
 namespace vglutil
 {
+	// Buffer descriptor for scatter-gather sends
+	typedef struct
+	{
+		char *buf;
+		int len;
+	} SockBuf;
+
 	class Socket
 	{
 		public:
@@ -153,7 +160,12 @@ namespace vglutil
 			unsigned short listen(unsigned short port, bool reuseAddr = false);
 			Socket *accept(void);
 			void send(char *buf, int len);
+			void sendv(SockBuf *bufs, int count);
 			void recv(char *buf, int len);
+			int recvSome(char *buf, int len);
+			int sendSome(char *buf, int len);
+			void setNonBlocking(bool nonBlocking);
+			SOCKET getSD(void) { return sd; }
 			const char *remoteName(void);
 
 		private:
@@ -176,10 +188,15 @@ namespace vglutil
 			static CriticalSection cryptoLock[CRYPTO_NUM_LOCKS];
 			#endif
 			bool doSSL;  SSL_CTX *sslctx;  SSL *ssl;
+			// Small buffers passed to sendv() are coalesced into this buffer so
+			// that they are sent as a single SSL record.
+			static const int SSLBATCH = 16384;
+			char sslBatch[SSLBATCH];
 
 			#endif
 
 			static const int MAXCONN = 1024;
+			static const int MAXIOV = 64;
 			static int instanceCount;
 			static CriticalSection mutex;
 			SOCKET sd;
@@ -73,6 +73,11 @@ typedef struct _fbx_struct
 	XImage *xi;
 	Pixmap pm;
 	int pixmap;
+	/* Size of the shared memory segment, which can be larger than the buffer,
+	   and statistics describing how often the buffer has been resized and how
+	   many shared memory segments have been allocated for it */
+	size_t shmSize;
+	int resizes, shmAllocs;
 	#endif
 } fbx_struct;
 
@@ -105,6 +110,11 @@ extern "C" {
   -- fbx_init() is idempotent.  If you call it multiple times, it will
      re-initialize the buffer only when it is necessary to do so (such as when
      the window size has changed.)
+  -- On Unix, if the buffer is re-initialized because the window size has
+     changed, then the existing shared memory segment is reused if it is large
+     enough to hold the new buffer.  Otherwise, the new segment is
+     over-allocated, so that subsequent growth can reuse it.  The shared memory
+     segment never shrinks until fbx_term() is called.
   -- On Windows, fbx_init() will return a buffer configured with the same pixel
      format as the screen, unless the screen depth is < 24 bits, in which case
      it will always return a 32-bit BGRA buffer.
@@ -214,6 +224,9 @@ int fbx_sync(fbx_struct *fb);
   (fbx_struct *fb)
 
   Free the memory buffers pointed to by structure fb.
+  If warnings are enabled (see fbx_printwarnings()), then this routine also
+  reports how many times the buffer was resized and how many shared memory
+  segments were allocated for it.
 
   NOTE: this routine is idempotent.  It only frees stuff that needs freeing.
 */
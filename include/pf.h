@@ -22,6 +22,13 @@ enum
 	PF_X2_BGR10, PF_XRGB, PF_X2_RGB10, PF_COMP
 };
 
+/* Gamma correction implementations (see pf_gammainit()) */
+enum
+{
+	PF_GAMMA_NONE, PF_GAMMA_AUTO, PF_GAMMA_SSE41, PF_GAMMA_AVX2,
+	PF_GAMMA_AVX512, PF_GAMMA_NEON
+};
+
 
 typedef const struct _PF
 {
@@ -46,6 +53,22 @@ extern "C" {
 
 PF *pf_get(int id);
 
+/* Gamma-correct an image in place.  lut (256 entries) and lut16 (65536
+   entries, each of which corrects two adjacent bytes) are used with 8-bit
+   formats, and lut10 (1024 entries) is used with 10-bit formats. */
+void pf_gamma(PF *pf, unsigned char *buf, int width, int pitch, int height,
+	const unsigned char *lut, const unsigned short *lut16,
+	const unsigned int *lut10);
+
+/* Select the gamma correction implementation that uses the specified
+   instruction set (PF_GAMMA_NONE = scalar, PF_GAMMA_AUTO = the fastest
+   implementation supported by the CPU), and return the name of the
+   instruction set ("None" if none.)  If the CPU does not support the specified
+   instruction set, then this returns NULL and leaves the current selection
+   unchanged.  pf_gamma() selects PF_GAMMA_AUTO the first time it is called,
+   unless an implementation has already been selected. */
+const char *pf_gammainit(int simd);
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,6 +25,11 @@ using namespace vglcommon;
 using namespace vglserver;
 
 
+// If refinement is enabled, then the unrefined tiles in the last frame are
+// refined if no new frame arrives within this many seconds.
+#define REFINE_IDLE  0.25
+
+
 #define ENDIANIZE(h) \
 { \
 	if(!LittleEndian()) \
@@ -56,6 +61,15 @@ using namespace vglserver;
 	} \
 }
 
+#define ENDIANIZE_BATCH(h) \
+{ \
+	if(!LittleEndian()) \
+	{ \
+		h.size = BYTESWAP(h.size); \
+		h.tiles = BYTESWAP(h.tiles); \
+	} \
+}
+
 #define CONVERT_HEADER(h, h1) \
 { \
 	h1.size = h.size; \
@@ -73,74 +87,146 @@ using namespace vglserver;
 }
 
 
-void VGLTrans::sendHeader(rrframeheader h, bool eof)
+// Negotiate the protocol version with the client, using the header of the
+// first frame.  This is called by the transport thread before the first frame
+// is passed to the compressor and sender threads, so those threads can read
+// the version without synchronization.
+void VGLTrans::negotiate(rrframeheader h)
 {
-	if(version.major == 0 && version.minor == 0)
+	// Fake up an old (protocol v1.0) EOF packet and see if the client sends
+	// back a CTS signal.  If so, it needs protocol 1.0
+	rrframeheader_v1 h1;  char reply = 0;
+	CONVERT_HEADER(h, h1);
+	h1.flags = RR_EOF;
+	ENDIANIZE_V1(h1);
+	if(socket)
 	{
-		// Fake up an old (protocol v1.0) EOF packet and see if the client sends
-		// back a CTS signal.  If so, it needs protocol 1.0
-		rrframeheader_v1 h1;  char reply = 0;
-		CONVERT_HEADER(h, h1);
-		h1.flags = RR_EOF;
-		ENDIANIZE_V1(h1);
-		if(socket)
+		send((char *)&h1, sizeof_rrframeheader_v1);
+		recv(&reply, 1);
+		if(reply == 1)
 		{
-			send((char *)&h1, sizeof_rrframeheader_v1);
-			recv(&reply, 1);
-			if(reply == 1)
-			{
-				version.major = 1;  version.minor = 0;
-			}
-			else if(reply == 'V')
-			{
-				rrversion v;
-				version.id[0] = reply;
-				recv(&version.id[1], sizeof_rrversion - 1);
-				if(strncmp(version.id, "VGL", 3) || version.major < 1)
-					THROW("Error reading client version");
-				v = version;
-				v.major = RR_MAJOR_VERSION;  v.minor = RR_MINOR_VERSION;
-				send((char *)&v, sizeof_rrversion);
-			}
-			if(fconfig.verbose)
-				vglout.println("[VGL] Client version: %d.%d", version.major,
-					version.minor);
+			version.major = 1;  version.minor = 0;
 		}
+		else if(reply == 'V')
+		{
+			rrversion v;
+			version.id[0] = reply;
+			recv(&version.id[1], sizeof_rrversion - 1);
+			if(strncmp(version.id, "VGL", 3) || version.major < 1)
+				THROW("Error reading client version");
+			v = version;
+			v.major = RR_MAJOR_VERSION;  v.minor = RR_MINOR_VERSION;
+			send((char *)&v, sizeof_rrversion);
+		}
+		if(fconfig.verbose)
+			vglout.println("[VGL] Client version: %d.%d", version.major,
+				version.minor);
 	}
+}
+
+
+// Encode a frame header using the protocol version that the client supports,
+// and append it to the current batch along with the corresponding payload
+// (h.size bytes starting at buf.)
+void VGLTrans::queue(rrframeheader h, char *buf, bool eof)
+{
 	if((version.major < 2 || (version.major == 2 && version.minor < 1))
 		&& h.compress != RRCOMP_JPEG)
 		THROW("This compression mode requires VirtualGL Client v2.1 or later");
 	if(eof) h.flags = RR_EOF;
+
+	if(batchHdrCount >= maxBatchHdrs)
+	{
+		int newMaxBatchHdrs = maxBatchHdrs ? maxBatchHdrs * 2 : MAXBATCH * 2 + 1;
+		char *newBatchHdrs = (char *)realloc(batchHdrs,
+			newMaxBatchHdrs * sizeof_rrframeheader);
+		if(!newBatchHdrs) THROW("Memory allocation error");
+		batchHdrs = newBatchHdrs;
+		vglutil::SockBuf *newBatch = (vglutil::SockBuf *)realloc(batch,
+			sizeof(vglutil::SockBuf) * (newMaxBatchHdrs * 2 + 2));
+		if(!newBatch) THROW("Memory allocation error");
+		batch = newBatch;  maxBatchHdrs = newMaxBatchHdrs;
+	}
+	// The header pointers are filled in by flush(), since batchHdrs may be
+	// reallocated before then.
+	vglutil::SockBuf *sb = &batch[batchHdrCount * 2 + 2];
+	char *hbuf = &batchHdrs[batchHdrCount * sizeof_rrframeheader];
 	if(version.major == 1 && version.minor == 0)
 	{
 		rrframeheader_v1 h1;
 		if(h.dpynum > 255) THROW("Display number out of range for v1.0 client");
 		CONVERT_HEADER(h, h1);
 		ENDIANIZE_V1(h1);
-		if(socket)
-		{
-			send((char *)&h1, sizeof_rrframeheader_v1);
-			if(eof)
-			{
-				char cts = 0;
-				recv(&cts, 1);
-				if(cts < 1 || cts > 2) THROW("CTS Error");
-			}
-		}
+		memcpy(hbuf, &h1, sizeof_rrframeheader_v1);
+		sb[0].len = sizeof_rrframeheader_v1;
 	}
 	else
 	{
+		int size = h.size;
 		ENDIANIZE(h);
-		send((char *)&h, sizeof_rrframeheader);
+		memcpy(hbuf, &h, sizeof_rrframeheader);
+		sb[0].len = sizeof_rrframeheader;
+		h.size = size;
+	}
+	sb[1].buf = buf;  sb[1].len = eof ? 0 : h.size;
+	batchHdrCount++;  batchBytes += sb[1].len;
+}
+
+
+void VGLTrans::sendHeader(rrframeheader h, bool eof)
+{
+	queue(h, NULL, eof);
+	flush();
+	if(eof && version.major == 1 && version.minor == 0 && socket)
+	{
+		char cts = 0;
+		recv(&cts, 1);
+		if(cts < 1 || cts > 2) THROW("CTS Error");
+	}
+}
+
+
+// Send everything in the current batch using a single vectored send.  With
+// protocol v2.2 and later, the batch is preceded by a batch header and a tile
+// index, so the client can validate the batch and then receive all of the
+// compressed images using a single read.
+void VGLTrans::flush(void)
+{
+	int count = batchHdrCount, bytes = batchBytes, i;
+
+	clearBatch();
+	if(count < 1) return;
+	for(i = 0; i < count; i++)
+		batch[i * 2 + 2].buf = &batchHdrs[i * sizeof_rrframeheader];
+	try
+	{
+		if(framed())
+		{
+			rrbatchheader bh;
+			bh.size = count * sizeof_rrframeheader + bytes;  bh.tiles = count;
+			ENDIANIZE_BATCH(bh);
+			batch[0].buf = (char *)&bh;  batch[0].len = sizeof_rrbatchheader;
+			batch[1].buf = batchHdrs;  batch[1].len = count * sizeof_rrframeheader;
+			for(i = 0; i < count; i++) batch[i * 2 + 2].len = 0;
+			if(socket) socket->sendv(batch, count * 2 + 2);
+		}
+		else if(socket) socket->sendv(&batch[2], count * 2);
+	}
+	catch(...)
+	{
+		vglout.println("[VGL] ERROR: Could not send data to client.  Client may have disconnected.");
+		throw;
 	}
 }
 
 
 VGLTrans::VGLTrans(void) : nprocs(fconfig.np), socket(NULL), thread(NULL),
-	deadYet(false), dpynum(0)
+	deadYet(false), dpynum(0), batch(NULL), batchHdrs(NULL), batchHdrCount(0),
+	maxBatchHdrs(0), batchBytes(0),
+	tiles(NULL), nTiles(0), maxTiles(0), tileIndex(0), tileAbort(false),
+	refineAll(false), sendSlots(NSENDFRAMES)
 {
 	memset(&version, 0, sizeof(rrversion));
-	profTotal.setName("Total     ");
 	#ifdef USEHELGRIND
 	ANNOTATE_BENIGN_RACE_SIZED(&deadYet, sizeof(bool), );
 	// NOTE: Without this line, helgrind reports a data race on the class
@@ -153,16 +239,21 @@ VGLTrans::VGLTrans(void) : nprocs(fconfig.np), socket(NULL), thread(NULL),
 void VGLTrans::run(void)
 {
 	Frame *lastf = NULL, *f = NULL;
-	long bytes = 0;
-	Timer timer, sleepTimer;  double err = 0.;  bool first = true;
 	int i;
+	VGLTrans::Compressor **comp = NULL;  Thread **cthread = NULL;
+	VGLTrans::Sender *sender = NULL;  Thread *sthread = NULL;
 
 	try
 	{
-		VGLTrans::Compressor *comp[MAXPROCS];  Thread *cthread[MAXPROCS];
 		if(fconfig.verbose)
 			vglout.println("[VGL] Using %d compression threads on %d CPU cores",
 				nprocs, NumProcs());
+		NEWCHECK(comp = new VGLTrans::Compressor *[nprocs]);
+		NEWCHECK(cthread = new Thread *[nprocs]);
+		for(i = 0; i < nprocs; i++)
+		{
+			comp[i] = NULL;  cthread[i] = NULL;
+		}
 		for(i = 0; i < nprocs; i++)
 			NEWCHECK(comp[i] = new VGLTrans::Compressor(i, this));
 		if(nprocs > 1) for(i = 1; i < nprocs; i++)
@@ -170,16 +261,41 @@ void VGLTrans::run(void)
 			NEWCHECK(cthread[i] = new Thread(comp[i]));
 			cthread[i]->start();
 		}
+		NEWCHECK(sender = new VGLTrans::Sender(this));
+		NEWCHECK(sthread = new Thread(sender));
+		sthread->start();
 
 		while(!deadYet)
 		{
 			int np;
 			void *ftemp = NULL;
 
-			q.get(&ftemp);  f = (Frame *)ftemp;  if(deadYet) break;
-			if(!f) THROW("Queue has been shut down");
-			ready.signal();
+			// Wait until the sender thread has caught up, so that frames continue to
+			// be spoiled (rather than piling up in sendQ) if the network is the
+			// bottleneck.
+			sendSlots.wait();  if(deadYet) break;
+			sthread->checkError();
+
+			// If some of the tiles in the last frame have not yet been refined, and
+			// no new frame arrives within REFINE_IDLE seconds, then refine all of
+			// those tiles by compressing the last frame again.
+			refineAll = false;
+			if(lastf && refinePending(lastf))
+			{
+				q.timedGet(&ftemp, REFINE_IDLE);  if(deadYet) break;
+				if(!ftemp) refineAll = true;
+			}
+			if(refineAll) f = lastf;
+			else
+			{
+				if(!ftemp) q.get(&ftemp);
+				f = (Frame *)ftemp;  if(deadYet) break;
+				if(!f) THROW("Queue has been shut down");
+				ready.signal();
+			}
+			if(version.major == 0 && version.minor == 0) negotiate(f->hdr);
 			np = nprocs;  if(f->hdr.compress == RRCOMP_YUV) np = 1;
+			initTiles(f);
 			if(np > 1)
 			{
 				for(i = 1; i < np; i++)
@@ -188,49 +304,36 @@ void VGLTrans::run(void)
 				}
 			}
 			comp[0]->compressSend(f, lastf);
-			bytes += comp[0]->bytes;
 			if(np > 1)
 			{
 				for(i = 1; i < np; i++)
 				{
-					comp[i]->stop();  cthread[i]->checkError();  comp[i]->send();
-					bytes += comp[i]->bytes;
+					comp[i]->stop();  cthread[i]->checkError();
 				}
 			}
-			sendHeader(f->hdr, true);
-
-			profTotal.endFrame(f->hdr.width * f->hdr.height, bytes, 1);
-			bytes = 0;
-			profTotal.startFrame();
 
-			if(fconfig.flushdelay > 0.)
-			{
-				long usec = (long)(fconfig.flushdelay * 1000000.);
-				if(usec > 0) usleep(usec);
-			}
-			if(fconfig.fps > 0.)
+			void *eof = NULL;
+			eofPool.get(&eof, true);
+			if(!eof) { NEWCHECK(eof = (void *)new PooledFrame(&eofPool)); }
+			((CompressedFrame *)eof)->hdr = f->hdr;
+			((CompressedFrame *)eof)->hdr.flags = RR_EOF;
+			sendQ.add(eof);
+
+			// The compressed tiles are independent of the source frame, so the
+			// previous frame can be released as soon as the current frame (which
+			// replaces it as the reference for interframe comparison) has been
+			// compressed, even if it has not yet been sent.
+			if(f != lastf)
 			{
-				double elapsed = timer.elapsed();
-				if(first) first = false;
-				else
-				{
-					if(elapsed < 1. / fconfig.fps)
-					{
-						sleepTimer.start();
-						long usec = (long)((1. / fconfig.fps - elapsed - err) * 1000000.);
-						if(usec > 0) usleep(usec);
-						double sleepTime = sleepTimer.elapsed();
-						err = sleepTime - (1. / fconfig.fps - elapsed - err);
-						if(err < 0.) err = 0.;
-					}
-				}
-				timer.start();
+				if(lastf) lastf->signalComplete();
+				lastf = f;
 			}
-
-			if(lastf) lastf->signalComplete();
-			lastf = f;
 		}
 
+		// The sender thread must be shut down first, since it returns the
+		// compressed tiles to the compressors' pools.
+		sender->shutdown();  sthread->stop();
+		delete sthread;  sthread = NULL;  delete sender;  sender = NULL;
 		for(i = 0; i < nprocs; i++) comp[i]->shutdown();
 		if(nprocs > 1) for(i = 1; i < nprocs; i++)
 		{
@@ -239,10 +342,15 @@ void VGLTrans::run(void)
 			delete cthread[i];
 		}
 		for(i = 0; i < nprocs; i++) delete comp[i];
-
+		delete [] comp;  delete [] cthread;
 	}
 	catch(Error &e)
 	{
+		if(sthread)
+		{
+			sender->shutdown();  sthread->stop();
+			delete sthread;  delete sender;
+		}
 		if(thread) thread->setError(e);
 		ready.signal();
 		throw;
@@ -250,8 +358,145 @@ void VGLTrans::run(void)
 }
 
 
-Frame *VGLTrans::getFrame(int width, int height, int pixelFormat, int flags,
-	bool stereo)
+// The sender thread transmits compressed tiles and end-of-frame markers in the
+// order in which they were queued.  Tiles that are already waiting in the queue
+// are batched, so that several tile headers and payloads can be sent using a
+// single system call, but the sender never waits for more tiles in order to
+// fill a batch.  Thus, the client can start decompressing a frame before all of
+// its tiles have been compressed.  A batch never spans more than one frame,
+// since the end-of-frame marker flushes the batch.  If an error occurs, then
+// the remaining items are discarded (but still recycled), so that the transport
+// thread never blocks waiting for a slot, and the error is reported to the
+// transport thread by way of Thread::checkError().
+void VGLTrans::Sender::run(void)
+{
+	Timer timer, sleepTimer;  double err = 0.;  bool first = true;
+	long bytes = 0;
+
+	while(1)
+	{
+		void *item = NULL;
+
+		if(nPending > 0)
+		{
+			parent->sendQ.get(&item, true);
+			if(!item) { sendBatch();  continue; }
+		}
+		else parent->sendQ.get(&item);
+		if(!item || item == (void *)this) { sendBatch();  break; }
+		CompressedFrame *cf = (CompressedFrame *)item;
+		bool eof = (cf->hdr.flags == RR_EOF);
+
+		try
+		{
+			if(!lastError)
+			{
+				if(eof)
+				{
+					// The end-of-frame marker is sent along with any tiles that are
+					// still batched.
+					parent->sendHeader(cf->hdr, true);
+					sendBatch();
+
+					profTotal.endFrame(cf->hdr.width * cf->hdr.height, bytes, 1);
+					bytes = 0;
+					profTotal.startFrame();
+
+					if(fconfig.flushdelay > 0.)
+					{
+						long usec = (long)(fconfig.flushdelay * 1000000.);
+						if(usec > 0) usleep(usec);
+					}
+					if(fconfig.fps > 0.)
+					{
+						double elapsed = timer.elapsed();
+						if(first) first = false;
+						else
+						{
+							if(elapsed < 1. / fconfig.fps)
+							{
+								sleepTimer.start();
+								long usec =
+									(long)((1. / fconfig.fps - elapsed - err) * 1000000.);
+								if(usec > 0) usleep(usec);
+								double sleepTime = sleepTimer.elapsed();
+								err = sleepTime - (1. / fconfig.fps - elapsed - err);
+								if(err < 0.) err = 0.;
+							}
+						}
+						timer.start();
+					}
+				}
+				else
+				{
+					if(nPending >= maxPending)
+					{
+						int newMaxPending = maxPending ? maxPending * 2 : MAXBATCH;
+						PooledFrame **newPending = (PooledFrame **)realloc(pending,
+							sizeof(PooledFrame *) * newMaxPending);
+						if(!newPending) THROW("Memory allocation error");
+						pending = newPending;  maxPending = newMaxPending;
+					}
+					parent->queueTile(cf);
+					bytes += cf->hdr.size;
+					if(cf->stereo && cf->rbits) bytes += cf->rhdr.size;
+				}
+			}
+		}
+		catch(Error &e)
+		{
+			lastError = e;
+		}
+
+		if(eof)
+		{
+			sendBatch();
+			((PooledFrame *)cf)->release();
+			parent->sendSlots.post();
+		}
+		else if(nPending < maxPending)
+		{
+			pending[nPending++] = (PooledFrame *)cf;
+			if(nPending >= MAXBATCH || parent->batchBytes >= BATCHBYTES)
+				sendBatch();
+		}
+		else
+		{
+			// The pending list could not be grown, so the batch is discarded.
+			sendBatch();  ((PooledFrame *)cf)->release();
+		}
+	}
+}
+
+
+// Send the current batch, and return the tiles in it to their pools
+void VGLTrans::Sender::sendBatch(void)
+{
+	try
+	{
+		if(!lastError) parent->flush();
+	}
+	catch(Error &e)
+	{
+		lastError = e;
+	}
+	parent->clearBatch();
+	for(int i = 0; i < nPending; i++) pending[i]->release();
+	nPending = 0;
+}
+
+
+void VGLTrans::Sender::shutdown(void)
+{
+	parent->sendQ.add((void *)this);
+	parent->sendSlots.post();
+}
+
+
+// If bits is not NULL, then it is used as the frame's pixel buffer (see
+// Frame::initExternal()), and it must remain valid until the frame is
+// complete.  Otherwise, the frame's own pixel buffer is used.
+Frame *VGLTrans::getFreeFrame(void)
 {
 	Frame *f = NULL;
 
@@ -266,13 +511,44 @@ Frame *VGLTrans::getFrame(int width, int height, int pixelFormat, int flags,
 		if(index < 0) THROW("No free buffers in pool");
 		f = &frames[index];  f->waitUntilComplete();
 	}
+	return f;
+}
+
+
+Frame *VGLTrans::getFrame(int width, int height, int pixelFormat, int flags,
+	bool stereo, unsigned char *bits)
+{
+	Frame *f = getFreeFrame();
+	if(!f) return NULL;
 
 	rrframeheader hdr;
 	memset(&hdr, 0, sizeof(rrframeheader));
 	hdr.x = hdr.y = 0;
 	hdr.width = hdr.framew = width;
 	hdr.height = hdr.frameh = height;
-	f->init(hdr, pixelFormat, flags, stereo);
+	if(bits)
+	{
+		if(stereo) THROW("Invalid argument");
+		f->initExternal(hdr, pixelFormat, flags, bits,
+			width * pf_get(pixelFormat)->size);
+	}
+	else f->init(hdr, pixelFormat, flags, stereo);
+	return f;
+}
+
+
+// Get a frame into which a planar YUV 4:2:0 image can be read back (see
+// Frame::initYUV())
+Frame *VGLTrans::getYUVFrame(int width, int height)
+{
+	Frame *f = getFreeFrame();
+	if(!f) return NULL;
+
+	rrframeheader hdr;
+	memset(&hdr, 0, sizeof(rrframeheader));
+	hdr.width = hdr.framew = width;
+	hdr.height = hdr.frameh = height;
+	f->initYUV(hdr);
 	return f;
 }
 
@@ -304,26 +580,22 @@ void VGLTrans::sendFrame(Frame *f)
 }
 
 
-void VGLTrans::Compressor::compressSend(Frame *f, Frame *lastf)
+void VGLTrans::initTiles(Frame *f)
 {
-	CompressedFrame cframe;
-
-	if(!f) return;
 	int tilesizex = fconfig.tilesize ? fconfig.tilesize : f->hdr.width;
 	int tilesizey = fconfig.tilesize ? fconfig.tilesize : f->hdr.height;
-	int i, j, n = 0;
+	int i, j, lastNTiles = nTiles;
 
-	if(f->hdr.compress == RRCOMP_YUV)
+	// The tiles of a YUV frame must start at even coordinates.
+	if(f->chroma[0])
 	{
-		profComp.startFrame();
-		cframe = *f;
-		profComp.endFrame(f->hdr.framew * f->hdr.frameh, 0, 1);
-		parent->sendHeader(cframe.hdr);
-		parent->send((char *)cframe.bits, cframe.hdr.size);
-		return;
+		tilesizex += tilesizex % 2;  tilesizey += tilesizey % 2;
 	}
 
-	bytes = 0;
+	CriticalSection::SafeLock l(tileMutex);
+	nTiles = tileIndex = 0;  tileAbort = false;
+	if(f->hdr.compress == RRCOMP_YUV) return;
+
 	for(i = 0; i < f->hdr.height; i += tilesizey)
 	{
 		int height = tilesizey, y = i;
@@ -332,7 +604,7 @@ void VGLTrans::Compressor::compressSend(Frame *f, Frame *lastf)
 		{
 			height = f->hdr.height - i;  i += tilesizey;
 		}
-		for(j = 0; j < f->hdr.width; j += tilesizex, n++)
+		for(j = 0; j < f->hdr.width; j += tilesizex)
 		{
 			int width = tilesizex, x = j;
 
@@ -340,38 +612,205 @@ void VGLTrans::Compressor::compressSend(Frame *f, Frame *lastf)
 			{
 				width = f->hdr.width - j;  j += tilesizex;
 			}
-			if(n % nprocs != myRank) continue;
-			if(fconfig.interframe)
+			if(nTiles >= maxTiles)
 			{
-				if(f->tileEquals(lastf, x, y, width, height)) continue;
+				int newMaxTiles = maxTiles ? maxTiles * 2 : 64;
+				Tile *newTiles = (Tile *)realloc(tiles, sizeof(Tile) * newMaxTiles);
+				if(!newTiles) THROW("Memory allocation error");
+				tiles = newTiles;  maxTiles = newMaxTiles;
 			}
-			Frame *tile = f->getTile(x, y, width, height);
-			CompressedFrame *ctile = NULL;
-			if(myRank > 0) { NEWCHECK(ctile = new CompressedFrame()); }
-			else ctile = &cframe;
-			profComp.startFrame();
-			*ctile = *tile;
-			double frames = (double)(tile->hdr.width * tile->hdr.height) /
-				(double)(tile->hdr.framew * tile->hdr.frameh);
-			profComp.endFrame(tile->hdr.width * tile->hdr.height, 0, frames);
-			bytes += ctile->hdr.size;
-			if(ctile->stereo) bytes += ctile->rhdr.size;
-			delete tile;
-			if(myRank == 0)
+			Tile &tile = tiles[nTiles];
+			// The fingerprint from the last frame remains valid only if the tile
+			// layout is unchanged.
+			if(nTiles >= lastNTiles || tile.x != x || tile.y != y
+				|| tile.width != width || tile.height != height)
 			{
-				parent->sendHeader(ctile->hdr);
-				parent->send((char *)ctile->bits, ctile->hdr.size);
-				if(ctile->stereo && ctile->rbits)
+				tile.hash = 0;  tile.staticFrames = 0;  tile.refined = false;
+			}
+			tile.x = x;  tile.y = y;  tile.width = width;  tile.height = height;
+			nTiles++;
+		}
+	}
+}
+
+
+void VGLTrans::freeTiles(void)
+{
+	void *cf = NULL;
+
+	free(tiles);  tiles = NULL;
+	nTiles = maxTiles = 0;
+	while(1)
+	{
+		cf = NULL;
+		eofPool.get(&cf, true);  if(!cf) break;
+		delete (PooledFrame *)cf;
+	}
+}
+
+
+// Returns the index of the next tile that needs to be compressed, or -1 if
+// there are no more tiles in the current frame
+int VGLTrans::nextTile(void)
+{
+	CriticalSection::SafeLock l(tileMutex);
+	if(tileAbort || tileIndex >= nTiles) return -1;
+	return tileIndex++;
+}
+
+
+void VGLTrans::abortTiles(void)
+{
+	CriticalSection::SafeLock l(tileMutex);
+	tileAbort = true;
+}
+
+
+// Returns true if refinement is enabled and some of the tiles in the given
+// frame (which must be the most recently compressed frame) have not yet been
+// refined
+bool VGLTrans::refinePending(Frame *f)
+{
+	if(!fconfig.refine || !fconfig.interframe || f->hdr.compress != RRCOMP_JPEG)
+		return false;
+	for(int i = 0; i < nTiles; i++)
+		if(!tiles[i].refined) return true;
+	return false;
+}
+
+
+void VGLTrans::queueTile(CompressedFrame *cf)
+{
+	queue(cf->hdr, (char *)cf->bits);
+	if(cf->stereo && cf->rbits) queue(cf->rhdr, (char *)cf->rbits);
+}
+
+
+// Compressed tile buffers are recycled once they have been sent, so each
+// compressor's pool only grows to the number of its tiles that are in flight at
+// any given time.
+VGLTrans::PooledFrame *VGLTrans::Compressor::getCFrame(long &allocs)
+{
+	void *cf = NULL;
+
+	pool.get(&cf, true);
+	if(!cf)
+	{
+		NEWCHECK(cf = (void *)new PooledFrame(tjhnd, &pool));
+		allocs++;
+	}
+	return (PooledFrame *)cf;
+}
+
+
+void VGLTrans::Compressor::compressSend(Frame *f, Frame *lastf)
+{
+	int index;
+
+	if(!f) return;
+
+	if(f->hdr.compress == RRCOMP_YUV)
+	{
+		long allocs = 0;
+		PooledFrame *cframe = getCFrame(allocs);
+		long lastAllocs = cframe->allocs;
+		profComp.startFrame();
+		try
+		{
+			*cframe = *f;
+		}
+		catch(...)
+		{
+			cframe->release();  throw;
+		}
+		profComp.endFrame(f->hdr.framew * f->hdr.frameh, 0, 1);
+		profComp.addAllocs(allocs + cframe->allocs - lastAllocs);
+		parent->sendQ.add(cframe);
+		return;
+	}
+
+	bytes = 0;
+	while((index = parent->nextTile()) >= 0)
+	{
+		Tile &t = parent->tiles[index];
+		int x = t.x, y = t.y, width = t.width, height = t.height;
+		bool refine = false;
+
+		if(fconfig.interframe)
+		{
+			if(!fconfig.fingerprint) t.hash = 0;
+			if(f->tileEquals(lastf, t.x, t.y, t.width, t.height,
+				fconfig.fingerprint ? &t.hash : NULL))
+			{
+				// In refinement mode, a tile that has remained unchanged for
+				// VGL_REFINE frames (or for REFINE_IDLE seconds) is sent again with
+				// higher quality.
+				t.staticFrames++;
+				if(!fconfig.refine || f->hdr.compress != RRCOMP_JPEG || t.refined
+					|| (t.staticFrames < fconfig.refine && !parent->refineAll))
+					continue;
+				refine = true;
+			}
+			else
+			{
+				t.staticFrames = 0;  t.refined = false;
+				// In adaptive tiling mode, send only the bounding box of the changed
+				// pixels, unless most of the tile has changed.
+				if(fconfig.adaptivetiles)
 				{
-					parent->sendHeader(ctile->rhdr);
-					parent->send((char *)ctile->rbits, ctile->rhdr.size);
+					if(!f->dirtyRect(lastf, x, y, width, height)) continue;
+					if(width * height > t.width * t.height * 3 / 4)
+					{
+						x = t.x;  y = t.y;  width = t.width;  height = t.height;
+					}
 				}
 			}
-			else
+		}
+		else
+		{
+			t.hash = 0;  t.staticFrames = 0;  t.refined = false;
+		}
+		f->getTile(tile, x, y, width, height);
+		if(refine)
+		{
+			// The chrominance of a YUV frame has already been subsampled, so its
+			// tiles can only be refined by increasing the JPEG quality.  Clients
+			// older than v2.1 cannot receive RGB-encoded tiles, so lossless
+			// refinement falls back to 4:4:4 JPEG with quality 100 for those
+			// clients.
+			rrversion &version = parent->version;
+			if(f->chroma[0])
+				tile.hdr.qual = fconfig.refinequal > 0 ? fconfig.refinequal : 100;
+			else if(fconfig.refinequal > 0)
+			{
+				tile.hdr.qual = fconfig.refinequal;  tile.hdr.subsamp = 1;
+			}
+			else if(version.major < 2 || (version.major == 2 && version.minor < 1))
 			{
-				store(ctile);
+				tile.hdr.qual = 100;  tile.hdr.subsamp = 1;
 			}
+			else tile.hdr.compress = RRCOMP_RGB;
+			t.refined = true;
+		}
+		long allocs = 0;
+		PooledFrame *ctile = getCFrame(allocs);
+		long lastAllocs = ctile->allocs;
+		profComp.startFrame();
+		try
+		{
+			*ctile = tile;
+		}
+		catch(...)
+		{
+			ctile->release();  throw;
 		}
+		double frames = (double)(tile.hdr.width * tile.hdr.height) /
+			(double)(tile.hdr.framew * tile.hdr.frameh);
+		profComp.endFrame(tile.hdr.width * tile.hdr.height, 0, frames);
+		profComp.addAllocs(allocs + ctile->allocs - lastAllocs);
+		bytes += ctile->hdr.size;
+		if(ctile->stereo) bytes += ctile->rhdr.size;
+		parent->sendQ.add(ctile);
 	}
 }
 
@@ -470,21 +909,3 @@ void VGLTrans::connect(char *displayName, unsigned short port)
 	free(serverName);
 }
 
-
-void VGLTrans::Compressor::send(void)
-{
-	for(int i = 0; i < storedFrames; i++)
-	{
-		CompressedFrame *cf = cframes[i];
-		ERRIFNOT(cf);
-		parent->sendHeader(cf->hdr);
-		parent->send((char *)cf->bits, cf->hdr.size);
-		if(cf->stereo && cf->rbits)
-		{
-			parent->sendHeader(cf->rhdr);
-			parent->send((char *)cf->rbits, cf->rhdr.size);
-		}
-		delete cf;
-	}
-	storedFrames = 0;
-}
@@ -36,17 +36,23 @@ namespace vglserver
 
 			virtual ~VGLTrans(void)
 			{
-				deadYet = true;  q.release();
+				deadYet = true;  q.release();  sendSlots.post();
 				if(thread) { thread->stop();  delete thread;  thread = NULL; }
 				delete socket;  socket = NULL;
+				freeTiles();
+				free(batch);  batch = NULL;
+				free(batchHdrs);  batchHdrs = NULL;
 			}
 
-			vglcommon::Frame *getFrame(int, int, int, int, bool stereo);
+			vglcommon::Frame *getFrame(int, int, int, int, bool stereo,
+				unsigned char *bits = NULL);
+			vglcommon::Frame *getYUVFrame(int width, int height);
 			bool isReady(void);
 			void synchronize(void);
 			void sendFrame(vglcommon::Frame *);
 			void run(void);
 			void sendHeader(rrframeheader h, bool eof = false);
+			void flush(void);
 			void send(char *, int);
 			void save(char *, int);
 			void recv(char *, int);
@@ -63,19 +69,125 @@ namespace vglserver
 			vglutil::Event ready;
 			vglutil::GenericQ q;
 			vglutil::Thread *thread;  bool deadYet;
-			vglcommon::Profiler profTotal;
 			int dpynum;
 			rrversion version;
 
+			// Tile headers and payloads are batched so that they can be sent to the
+			// client using a single vectored send.  Each header in the batch is
+			// paired with a payload (which is empty for end-of-frame markers.)  The
+			// encoded headers are stored contiguously in batchHdrs, so that they can
+			// also be sent as the tile index of a framed batch (protocol v2.2 and
+			// later.)  batch[2 * i + 2] and batch[2 * i + 3] describe the header and
+			// payload of the ith tile, and the first two elements are reserved for
+			// the batch header and tile index.  A batch is sent once it contains
+			// MAXBATCH tiles or BATCHBYTES bytes, or sooner if no more tiles are
+			// waiting to be sent.
+			static const int MAXBATCH = 32;
+			static const int BATCHBYTES = 65536;
+			vglutil::SockBuf *batch;
+			char *batchHdrs;
+			int batchHdrCount, maxBatchHdrs, batchBytes;
+
+			vglcommon::Frame *getFreeFrame(void);
+			bool framed(void)
+			{
+				return version.major > 2 || (version.major == 2 && version.minor >= 2);
+			}
+			void negotiate(rrframeheader h);
+			void queue(rrframeheader h, char *buf, bool eof = false);
+			void clearBatch(void) { batchHdrCount = batchBytes = 0; }
+
+			// Tiles from the current frame are placed in a shared queue, from which
+			// each compressor thread pulls the next available tile.  Each tile is
+			// passed to the sender thread as soon as it has been compressed.  The
+			// tile headers carry the tile position, so the client does not depend on
+			// the order in which the tiles arrive.  If VGL_FINGERPRINT is enabled,
+			// then the fingerprint of each tile is retained for interframe
+			// comparison with the next frame (0 = unknown.)
+			// staticFrames and refined are used to implement refinement (see
+			// VGL_REFINE.)
+			typedef struct
+			{
+				int x, y, width, height;
+				unsigned long long hash;
+				int staticFrames;
+				bool refined;
+			} Tile;
+
+			void initTiles(vglcommon::Frame *f);
+			void freeTiles(void);
+			int nextTile(void);
+			void abortTiles(void);
+			bool refinePending(vglcommon::Frame *f);
+			void queueTile(vglcommon::CompressedFrame *cf);
+
+			Tile *tiles;
+			int nTiles, maxTiles, tileIndex;
+			bool tileAbort, refineAll;
+			vglutil::CriticalSection tileMutex;
+			vglutil::GenericQ eofPool;
+
+			// Compressed tiles and end-of-frame markers are allocated from a pool
+			// (each compressor thread has its own pool of compressed tiles), and
+			// the sender thread returns them to that pool once they have been sent.
+			class PooledFrame : public vglcommon::CompressedFrame
+			{
+				public:
+
+					PooledFrame(vglutil::GenericQ *pool_) : pool(pool_) {}
+					PooledFrame(tjhandle tjhnd, vglutil::GenericQ *pool_) :
+						CompressedFrame(tjhnd), pool(pool_) {}
+					using vglcommon::CompressedFrame::operator=;
+					void release(void) { pool->add(this); }
+
+				private:
+
+					vglutil::GenericQ *pool;
+			};
+
+			// Compressed tiles and end-of-frame markers are sent to the client by a
+			// dedicated thread, so the compressors can move on to the next frame
+			// while the previous frame is still being transmitted.  No more than
+			// NSENDFRAMES frames can be compressed but not yet sent.
+			static const int NSENDFRAMES = 2;
+			vglutil::GenericQ sendQ;
+			vglutil::Semaphore sendSlots;
+
+		class Sender : public vglutil::Runnable
+		{
+			public:
+
+				Sender(VGLTrans *parent_) : pending(NULL), nPending(0),
+					maxPending(0), parent(parent_)
+				{
+					profTotal.setName("Total     ");
+				}
+
+				virtual ~Sender(void) { free(pending); }
+
+				void run(void);
+				void shutdown(void);
+
+			private:
+
+				void sendBatch(void);
+
+				// Tiles in the current batch, which are recycled once it is sent
+				PooledFrame **pending;
+				int nPending, maxPending;
+				vglcommon::Profiler profTotal;
+				VGLTrans *parent;
+		};
+
 		class Compressor : public vglutil::Runnable
 		{
 			public:
 
-				Compressor(int myRank_, VGLTrans *parent_) : bytes(0),
-					storedFrames(0), cframes(NULL), frame(NULL), lastFrame(NULL),
-					myRank(myRank_), deadYet(false), parent(parent_)
+				Compressor(int myRank_, VGLTrans *parent_) : bytes(0), frame(NULL),
+					lastFrame(NULL), tile(false), tjhnd(NULL), myRank(myRank_),
+					deadYet(false), parent(parent_)
 				{
-					if(parent) nprocs = parent->nprocs;
+					if(!(tjhnd = tjInitCompress())) THROW(tjGetErrorStr());
 					ready.wait();  complete.wait();
 					char temps[20];
 					snprintf(temps, 20, "Compress %d", myRank);
@@ -88,7 +200,13 @@ namespace vglserver
 				virtual ~Compressor(void)
 				{
 					shutdown();
-					free(cframes);  cframes = NULL;
+					while(1)
+					{
+						void *cf = NULL;
+						pool.get(&cf, true);  if(!cf) break;
+						delete (PooledFrame *)cf;
+					}
+					if(tjhnd) tjDestroy(tjhnd);
 				}
 
 				void run(void)
@@ -103,6 +221,7 @@ namespace vglserver
 						}
 						catch(...)
 						{
+							if(parent) parent->abortTiles();
 							complete.signal();  throw;
 						}
 					}
@@ -122,26 +241,22 @@ namespace vglserver
 				void shutdown(void) { deadYet = true;  ready.signal(); }
 				void compressSend(vglcommon::Frame *frame,
 					vglcommon::Frame *lastFrame);
-				void send(void);
 
 				long bytes;
 
 			private:
 
-				void store(vglcommon::CompressedFrame *cf)
-				{
-					storedFrames++;
-					if(!(cframes = (vglcommon::CompressedFrame **)realloc(cframes,
-						sizeof(vglcommon::CompressedFrame *) * storedFrames)))
-						THROW("Memory allocation error");
-					cframes[storedFrames - 1] = cf;
-				}
+				PooledFrame *getCFrame(long &allocs);
 
-				int storedFrames;  vglcommon::CompressedFrame **cframes;
 				vglcommon::Frame *frame, *lastFrame;
-				int myRank, nprocs;
+				// View of the tile that is currently being compressed
+				vglcommon::Frame tile;
+				// Persistent TurboJPEG compressor instance, shared by all of the
+				// compressed tiles in this compressor's pool
+				tjhandle tjhnd;
+				vglutil::GenericQ pool;
+				int myRank;
 				vglutil::Event ready, complete;  bool deadYet;
-				vglutil::CriticalSection mutex;
 				vglcommon::Profiler profComp;
 				VGLTrans *parent;
 		};
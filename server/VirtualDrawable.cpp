@@ -200,9 +200,28 @@ VirtualDrawable::VirtualDrawable(Display *dpy_, Drawable x11Draw_)
 	pbo = 0;
 	numSync = numFrames = 0;
 	lastFormat = -1;
-	usePBO = (fconfig.readback == RRREAD_PBO);
+	usePBO = (fconfig.readback != RRREAD_NONE
+		&& fconfig.readback != RRREAD_SYNC);
 	alreadyPrinted = alreadyWarned = alreadyWarnedRenderMode = false;
 	ext = NULL;
+	memset(ring, 0, sizeof(ring));  ringIndex = 0;
+	ringCtx = 0;  ringConfigID = 0;
+	deferReadback = drainReadback = alreadyWarnedSync = false;
+	drainDpy = NULL;  drainCtx = drainShareCtx = 0;  drainPB = 0;
+	memset(mapped, 0, sizeof(mapped));
+	mappedCtx = 0;  retiredCtx = NULL;  nRetiredCtx = 0;
+	alreadyWarnedMap = false;
+	yuvTex[0] = yuvTex[1] = yuvFBO = yuvProgram = 0;
+	yuvWidth = yuvHeight = yuvSizeLoc = yuvGammaLoc = -1;
+	yuvCtx = 0;  alreadyWarnedYUV = false;
+	memset(diffBufs, 0, sizeof(diffBufs));
+	diffMask = NULL;
+	memset(diffTex, 0, sizeof(diffTex));  memset(diffFBO, 0, sizeof(diffFBO));
+	memset(diffProgram, 0, sizeof(diffProgram));
+	diffWidth = diffHeight = diffPitch = -1;  diffCols = diffRows = 0;
+	diffRowSizeLoc = diffCellSizeLoc = -1;
+	diffFormat = GL_NONE;  diffCur = 0;  diffCount = 0;
+	diffPrevValid = false;  diffCtx = 0;  alreadyWarnedDiff = false;
 }
 
 
@@ -210,7 +229,16 @@ VirtualDrawable::~VirtualDrawable(void)
 {
 	mutex.lock(false);
 	delete oglDraw;  oglDraw = NULL;
+	destroyDrainContext();
+	if(drainDpy) { _XCloseDisplay(drainDpy);  drainDpy = NULL; }
 	if(ctx) { _glXDestroyContext(DPY3D, ctx);  ctx = 0; }
+	for(int i = 0; i < nRetiredCtx; i++) _glXDestroyContext(DPY3D, retiredCtx[i]);
+	free(retiredCtx);  retiredCtx = NULL;  nRetiredCtx = 0;
+	for(int i = 0; i < NDIFFBUFS; i++)
+	{
+		delete [] diffBufs[i].damage;  diffBufs[i].damage = NULL;
+	}
+	delete [] diffMask;  diffMask = NULL;
 	mutex.unlock(false);
 }
 
@@ -243,9 +271,7 @@ int VirtualDrawable::init(int width, int height, GLXFBConfig config_)
 		NEWCHECK(oglDraw = new OGLDrawable(width, height, config_));
 	}
 	if(config && FBCID(config_) != FBCID(config) && ctx)
-	{
-		_glXDestroyContext(DPY3D, ctx);  ctx = 0;
-	}
+		destroyContext();
 	config = config_;
 	return 1;
 }
@@ -255,10 +281,30 @@ void VirtualDrawable::setDirect(Bool direct_)
 {
 	if(direct_ != True && direct_ != False) return;
 	if(direct_ != direct && ctx)
+		destroyContext();
+	direct = direct_;
+}
+
+
+// Destroy the readback context, or retain it until this instance is destroyed
+// if the image transport might still be using PBOs that it owns (see
+// readPixelsMapped().)
+void VirtualDrawable::destroyContext(void)
+{
+	if(!ctx) return;
+	if(ctx == mappedCtx)
 	{
-		_glXDestroyContext(DPY3D, ctx);  ctx = 0;
+		GLXContext *newRetiredCtx = (GLXContext *)realloc(retiredCtx,
+			sizeof(GLXContext) * (nRetiredCtx + 1));
+		if(!newRetiredCtx) THROW("Memory allocation failure");
+		retiredCtx = newRetiredCtx;
+		retiredCtx[nRetiredCtx++] = ctx;
+		memset(mapped, 0, sizeof(mapped));  mappedCtx = 0;
 	}
-	direct = direct_;
+	else _glXDestroyContext(DPY3D, ctx);
+	ctx = 0;
+	memset(ring, 0, sizeof(ring));  ringIndex = 0;  ringCtx = 0;
+	yuvCtx = 0;  diffCtx = 0;
 }
 
 
@@ -340,7 +386,9 @@ bool VirtualDrawable::checkRenderMode(void)
 }
 
 
-void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
+// Returns false if the frame was deferred (see VGL_READBACK=async), in which
+// case bits does not contain a frame.
+bool VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 	GLint height, GLenum glFormat, PF *pf, GLubyte *bits, GLint readBuf,
 	bool stereo)
 {
@@ -354,19 +402,25 @@ void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 	}
 	if(glFormat == GL_NONE) THROW("Unsupported pixel format");
 
+	if(drainReadback)
+		return drainPixels(x, y, width, pitch, height, glFormat, type, bits,
+			readBuf);
+
 	// Whenever the readback format changes (perhaps due to switching
 	// compression or transports), then reset the PBO synchronicity detector
 	int currentFormat =
 		(glFormat == GL_GREEN || glFormat == GL_BLUE) ? GL_RED : glFormat;
 	if(lastFormat >= 0 && lastFormat != currentFormat)
 	{
-		usePBO = (fconfig.readback == RRREAD_PBO);
+		usePBO = (fconfig.readback != RRREAD_NONE
+			&& fconfig.readback != RRREAD_SYNC);
 		numSync = numFrames = 0;
 		alreadyPrinted = alreadyWarned = false;
 	}
 	lastFormat = currentFormat;
 
-	if(!checkRenderMode()) return;
+	if(!checkRenderMode()) return true;
+	resetDiff();
 
 	if(!ctx)
 	{
@@ -386,7 +440,48 @@ void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 	else if(pitch % 2 == 0) _glPixelStorei(GL_PACK_ALIGNMENT, 2);
 	else if(pitch % 1 == 0) _glPixelStorei(GL_PACK_ALIGNMENT, 1);
 
-	if(usePBO)
+	// Only complete frames are deferred.  The individual components of an
+	// anaglyphic frame and the eyes of a stereo frame are read back immediately.
+	bool defer = deferReadback && fconfig.readback == RRREAD_ASYNC && !stereo
+		&& glFormat != GL_RED && glFormat != GL_GREEN && glFormat != GL_BLUE;
+	if(ringCtx != ctx)
+	{
+		// The context that owned the PBOs and fences has been destroyed.
+		memset(ring, 0, sizeof(ring));  ringIndex = 0;
+		ringCtx = ctx;  ringConfigID = FBCID(config);
+	}
+	if(defer)
+	{
+		if(!ext) ext = (const char *)_glGetString(GL_EXTENSIONS);
+		if(!ext || !strstr(ext, "GL_ARB_pixel_buffer_object")
+			|| !strstr(ext, "GL_ARB_sync"))
+		{
+			if(!alreadyWarnedSync && fconfig.verbose)
+			{
+				vglout.println("[VGL] NOTICE: Deferred readback requires the GL_ARB_pixel_buffer_object and");
+				vglout.println("[VGL]    GL_ARB_sync extensions.  Using synchronous readback instead.");
+				alreadyWarnedSync = true;
+			}
+			defer = false;  usePBO = false;
+		}
+	}
+	if(!defer)
+	{
+		// A frame that is read back immediately supersedes any deferred frame.
+		for(int i = 0; i < NPBOS; i++)
+			if(ring[i].fence) releaseFence(ring[i]);
+	}
+
+	if(defer)
+	{
+		if(!alreadyPrinted && fconfig.verbose)
+		{
+			vglout.println("[VGL] Using deferred pixel buffer object readback (%s --> %s)",
+				formatString(oglDraw->getFormat()), formatString(glFormat));
+			alreadyPrinted = true;
+		}
+	}
+	else if(usePBO)
 	{
 		if(!ext)
 		{
@@ -425,10 +520,15 @@ void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 	int e = _glGetError();
 	while(e != GL_NO_ERROR) e = _glGetError();  // Clear previous error
 	profReadback.startFrame();
-	if(usePBO) t0 = GetTime();
-	_glReadPixels(x, y, width, height, glFormat, type, usePBO ? NULL : bits);
+	bool pboSync = usePBO && !defer, haveFrame = true;
+	if(pboSync) t0 = GetTime();
+	if(defer)
+		haveFrame = readPixelsDeferred(x, y, width, pitch, height, glFormat, type,
+			bits, readBuf);
+	else
+		_glReadPixels(x, y, width, height, glFormat, type, pboSync ? NULL : bits);
 
-	if(usePBO)
+	if(pboSync)
 	{
 		tRead = GetTime() - t0;
 		unsigned char *pboBits = NULL;
@@ -468,6 +568,7 @@ void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 
 	profReadback.endFrame(width * height, 0, stereo ? 0.5 : 1);
 	CHECKGL("Read Pixels");
+	if(!haveFrame) return false;
 
 	// If automatic faker testing is enabled, store the FB color in an
 	// environment variable so the test program can verify it
@@ -503,6 +604,486 @@ void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 		vglfaker::setAutotestDisplay(dpy);
 		vglfaker::setAutotestDrawable(x11Draw);
 	}
+	return true;
+}
+
+
+// Read back the current frame into the next PBO in the ring, then copy the
+// frame that was read back into the previous PBO into bits.  If there is no
+// pending frame with the same geometry and format (because this is the first
+// frame, or because the pending frame has already been copied out by the idle
+// thread), then nothing is copied into bits, and false is returned.
+bool VirtualDrawable::readPixelsDeferred(GLint x, GLint y, GLint width,
+	GLint pitch, GLint height, GLenum glFormat, GLenum type, GLubyte *bits,
+	GLint readBuf)
+{
+	PBOSlot &prev = ring[(ringIndex + NPBOS - 1) % NPBOS],
+		&cur = ring[ringIndex];
+	bool match = prev.fence && prev.x == x && prev.y == y
+		&& prev.width == width && prev.pitch == pitch && prev.height == height
+		&& prev.readBuf == readBuf && prev.glFormat == glFormat
+		&& prev.type == type;
+
+	if(prev.fence && !match) releaseFence(prev);
+	if(cur.fence) releaseFence(cur);
+
+	if(!cur.pbo) _glGenBuffers(1, &cur.pbo);
+	if(!cur.pbo) THROW("Could not generate pixel buffer object");
+	_glBindBuffer(GL_PIXEL_PACK_BUFFER_EXT, cur.pbo);
+	int size = 0;
+	_glGetBufferParameteriv(GL_PIXEL_PACK_BUFFER_EXT, GL_BUFFER_SIZE, &size);
+	if(size != pitch * height)
+		_glBufferData(GL_PIXEL_PACK_BUFFER_EXT, pitch * height, NULL,
+			GL_STREAM_READ);
+	_glGetBufferParameteriv(GL_PIXEL_PACK_BUFFER_EXT, GL_BUFFER_SIZE, &size);
+	if(size != pitch * height)
+		THROW("Could not set PBO size");
+	_glReadPixels(x, y, width, height, glFormat, type, NULL);
+	_glBindBuffer(GL_PIXEL_PACK_BUFFER_EXT, 0);
+	if(!(cur.fence = _glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)))
+		THROW("Could not create fence sync object");
+	// The idle thread may wait on the fence using a different context, so the
+	// fence must be flushed.
+	_glFlush();
+	cur.x = x;  cur.y = y;  cur.width = width;  cur.pitch = pitch;
+	cur.height = height;  cur.readBuf = readBuf;  cur.glFormat = glFormat;
+	cur.type = type;
+	ringIndex = (ringIndex + 1) % NPBOS;
+
+	if(!match) return false;
+	copyPBO(prev, bits);
+	releaseFence(prev);
+	return true;
+}
+
+
+// Copy the frame that was read back by the last call to readPixelsDeferred()
+// into bits, if it has not already been copied out, without reading back a new
+// frame.  This is called from the subclass's idle thread.
+bool VirtualDrawable::drainPixels(GLint x, GLint y, GLint width, GLint pitch,
+	GLint height, GLenum glFormat, GLenum type, GLubyte *bits, GLint readBuf)
+{
+	PBOSlot &prev = ring[(ringIndex + NPBOS - 1) % NPBOS];
+
+	if(!prev.fence || prev.x != x || prev.y != y || prev.width != width
+		|| prev.pitch != pitch || prev.height != height
+		|| prev.readBuf != readBuf || prev.glFormat != glFormat
+		|| prev.type != type)
+		return false;
+
+	if(drainCtx && drainShareCtx != ringCtx) destroyDrainContext();
+	if(!drainCtx)
+	{
+		if(!drainDpy && !(drainDpy = _XOpenDisplay(DisplayString(DPY3D))))
+			THROW("Could not clone 3D X server connection");
+		int attribs[] = { GLX_FBCONFIG_ID, ringConfigID, None }, n = 0;
+		GLXFBConfig *configs = _glXChooseFBConfig(drainDpy,
+			DefaultScreen(drainDpy), attribs, &n);
+		if(!configs || n < 1)
+		{
+			if(configs) XFree(configs);
+			THROW("Could not obtain FB config for deferred readback");
+		}
+		GLXFBConfig drainConfig = configs[0];
+		XFree(configs);
+		int pbattribs[] = { GLX_PBUFFER_WIDTH, 1, GLX_PBUFFER_HEIGHT, 1, None };
+		if(!(drainPB = _glXCreatePbuffer(drainDpy, drainConfig, pbattribs)))
+			THROW("Could not create Pbuffer for deferred readback");
+		if(!(drainCtx = _glXCreateNewContext(drainDpy, drainConfig,
+			GLX_RGBA_TYPE, ringCtx, direct)))
+		{
+			destroyDrainContext();
+			THROW("Could not create OpenGL context for deferred readback");
+		}
+		drainShareCtx = ringCtx;
+	}
+
+	if(!_glXMakeContextCurrent(drainDpy, drainPB, drainPB, drainCtx))
+		THROW("Could not make deferred readback context current");
+	try
+	{
+		copyPBO(prev, bits);
+		releaseFence(prev);
+	}
+	catch(...)
+	{
+		_glXMakeContextCurrent(drainDpy, 0, 0, 0);
+		throw;
+	}
+	_glXMakeContextCurrent(drainDpy, 0, 0, 0);
+	return true;
+}
+
+
+// Returns true if the frame that was read back by the last call to
+// readPixelsDeferred() has not yet been copied out
+bool VirtualDrawable::readbackPending(void)
+{
+	return ring[(ringIndex + NPBOS - 1) % NPBOS].fence != 0;
+}
+
+
+void VirtualDrawable::destroyDrainContext(void)
+{
+	if(drainCtx) { _glXDestroyContext(drainDpy, drainCtx);  drainCtx = 0; }
+	if(drainPB) { _glXDestroyPbuffer(drainDpy, drainPB);  drainPB = 0; }
+	drainShareCtx = 0;
+}
+
+
+// Wait for the readback into the specified PBO to complete, then copy its
+// contents into bits
+void VirtualDrawable::copyPBO(PBOSlot &slot, GLubyte *bits)
+{
+	GLenum ret;
+
+	do
+	{
+		ret = _glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+			1000000000);
+	} while(ret == GL_TIMEOUT_EXPIRED);
+	if(ret == GL_WAIT_FAILED) THROW("Could not wait for fence sync object");
+
+	_glBindBuffer(GL_PIXEL_PACK_BUFFER_EXT, slot.pbo);
+	unsigned char *pboBits = (unsigned char *)_glMapBuffer(
+		GL_PIXEL_PACK_BUFFER_EXT, GL_READ_ONLY);
+	if(!pboBits) THROW("Could not map pixel buffer object");
+	memcpy(bits, pboBits, slot.pitch * slot.height);
+	if(!_glUnmapBuffer(GL_PIXEL_PACK_BUFFER_EXT))
+		THROW("Could not unmap pixel buffer object");
+	_glBindBuffer(GL_PIXEL_PACK_BUFFER_EXT, 0);
+}
+
+
+void VirtualDrawable::releaseFence(PBOSlot &slot)
+{
+	_glDeleteSync(slot.fence);
+	slot.fence = 0;
+}
+
+
+// Read back a frame into a persistently mapped PBO that is not being used by
+// any image transport frame, and return a pointer to the mapped PBO memory, or
+// NULL if zero-copy readback cannot be used.  Once the caller has attached the
+// pointer to a transport frame, it must pass both to setMappedPBOOwner().
+GLubyte *VirtualDrawable::readPixelsMapped(GLint x, GLint y, GLint width,
+	GLint pitch, GLint height, GLenum glFormat, PF *pf, GLint readBuf)
+{
+	GLenum type = GL_UNSIGNED_BYTE;
+	MappedPBO *slot = NULL;
+	int size = pitch * height;
+
+	if(glFormat == GL_NONE)
+	{
+		glFormat = pf_glformat[pf->id];  type = pf_gldatatype[pf->id];
+	}
+	if(glFormat == GL_NONE) THROW("Unsupported pixel format");
+
+	if(!checkRenderMode()) return NULL;
+	resetDiff();
+
+	if(!ctx)
+	{
+		if(!isInit())
+			THROW("VirtualDrawable instance has not been fully initialized");
+		if((ctx = _glXCreateNewContext(DPY3D, config, GLX_RGBA_TYPE, NULL,
+			direct)) == 0)
+			THROW("Could not create OpenGL context for readback");
+	}
+	TempContext tc(DPY3D, getGLXDrawable(), getGLXDrawable(), ctx, config,
+		GLX_RGBA_TYPE);
+
+	if(!ext) ext = (const char *)_glGetString(GL_EXTENSIONS);
+	if(!ext || !strstr(ext, "GL_ARB_buffer_storage")
+		|| !strstr(ext, "GL_ARB_sync"))
+	{
+		if(!alreadyWarnedMap && fconfig.verbose)
+		{
+			vglout.println("[VGL] NOTICE: Zero-copy readback requires the GL_ARB_buffer_storage and");
+			vglout.println("[VGL]    GL_ARB_sync extensions.  Using PBO readback instead.");
+			alreadyWarnedMap = true;
+		}
+		return NULL;
+	}
+	if(mappedCtx != ctx)
+	{
+		memset(mapped, 0, sizeof(mapped));  mappedCtx = ctx;
+	}
+
+	// Use a free PBO of the correct size, if possible.
+	for(int i = 0; i < NMAPPEDPBOS; i++)
+	{
+		MappedPBO &m = mapped[i];
+		if(m.owner && !m.owner->isComplete()) continue;
+		if(!slot || (m.pbo && m.size == size
+			&& (!slot->pbo || slot->size != size)))
+			slot = &m;
+	}
+	if(!slot) return NULL;
+
+	if(!alreadyPrinted && fconfig.verbose)
+	{
+		vglout.println("[VGL] Using zero-copy pixel buffer object readback (%s --> %s)",
+			formatString(oglDraw->getFormat()), formatString(glFormat));
+		alreadyPrinted = true;
+	}
+
+	if(slot->pbo && slot->size != size)
+	{
+		// Deleting the PBO also unmaps it.
+		_glDeleteBuffers(1, &slot->pbo);
+		slot->pbo = 0;  slot->bits = NULL;  slot->size = 0;
+	}
+	if(!slot->pbo)
+	{
+		GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT
+			| GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		_glGenBuffers(1, &slot->pbo);
+		if(!slot->pbo) THROW("Could not generate pixel buffer object");
+		_glBindBuffer(GL_PIXEL_PACK_BUFFER_EXT, slot->pbo);
+		// The image transport reads the frame using the CPU, so ask for the PBO
+		// to be stored in (cached) system memory.
+		_glBufferStorage(GL_PIXEL_PACK_BUFFER_EXT, size, NULL,
+			flags | GL_CLIENT_STORAGE_BIT);
+		slot->bits = (GLubyte *)_glMapBufferRange(GL_PIXEL_PACK_BUFFER_EXT, 0,
+			size, flags);
+		if(!slot->bits)
+		{
+			_glBindBuffer(GL_PIXEL_PACK_BUFFER_EXT, 0);
+			_glDeleteBuffers(1, &slot->pbo);  slot->pbo = 0;
+			THROW("Could not map pixel buffer object");
+		}
+		slot->size = size;
+	}
+	else _glBindBuffer(GL_PIXEL_PACK_BUFFER_EXT, slot->pbo);
+	slot->owner = NULL;
+
+	_glReadBuffer(readBuf);
+
+	if(pitch % 8 == 0) _glPixelStorei(GL_PACK_ALIGNMENT, 8);
+	else if(pitch % 4 == 0) _glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	else if(pitch % 2 == 0) _glPixelStorei(GL_PACK_ALIGNMENT, 2);
+	else if(pitch % 1 == 0) _glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	int e = _glGetError();
+	while(e != GL_NO_ERROR) e = _glGetError();  // Clear previous error
+	profReadback.startFrame();
+	_glReadPixels(x, y, width, height, glFormat, type, NULL);
+	_glBindBuffer(GL_PIXEL_PACK_BUFFER_EXT, 0);
+
+	GLsync fence = _glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if(!fence) THROW("Could not create fence sync object");
+	GLenum ret;
+	do
+	{
+		ret = _glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+	} while(ret == GL_TIMEOUT_EXPIRED);
+	_glDeleteSync(fence);
+	if(ret == GL_WAIT_FAILED) THROW("Could not wait for fence sync object");
+
+	profReadback.endFrame(width * height, 0, 1);
+	CHECKGL("Read Pixels");
+
+	return slot->bits;
+}
+
+
+void VirtualDrawable::setMappedPBOOwner(GLubyte *bits,
+	vglcommon::Frame *owner)
+{
+	for(int i = 0; i < NMAPPEDPBOS; i++)
+	{
+		if(mapped[i].owner == owner) mapped[i].owner = NULL;
+		if(mapped[i].bits == bits) mapped[i].owner = owner;
+	}
+}
+
+
+// Build a shader program from the specified fragment shader.  Vertices are
+// processed by the fixed-function pipeline.
+static GLuint buildProgram(const GLchar *source)
+{
+	GLint status = 0;
+	GLuint shader = _glCreateShader(GL_FRAGMENT_SHADER), program;
+
+	if(!shader) THROW("Could not create fragment shader");
+	_glShaderSource(shader, 1, &source, NULL);
+	_glCompileShader(shader);
+	_glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if(!status) THROW("Could not compile fragment shader");
+	if(!(program = _glCreateProgram()))
+		THROW("Could not create shader program");
+	_glAttachShader(program, shader);
+	_glLinkProgram(program);
+	_glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if(!status) THROW("Could not link shader program");
+	return program;
+}
+
+
+// Each fragment of the render target produces one byte of the planar YUV
+// image.  The rows of the render target are numbered top-down, relative to
+// the source image.  The conversion uses the same (JFIF) coefficients as
+// libjpeg-turbo, and each chrominance sample is the average of the
+// corresponding 2x2 block of source pixels.  Gamma correction (if any) is
+// applied to the source pixels before they are converted.
+
+static const GLchar *yuvShaderSource =
+	"uniform sampler2D src;\n"
+	"uniform vec2 size;\n"
+	"uniform float gamma;\n"
+	"\n"
+	"vec3 fetch(vec2 pos)\n"
+	"{\n"
+	"	pos = clamp(pos, vec2(0.0), size - 1.0);\n"
+	"	return pow(texture2D(src, (pos + 0.5) / size).rgb, vec3(gamma));\n"
+	"}\n"
+	"\n"
+	"void main(void)\n"
+	"{\n"
+	"	vec2 pos = floor(gl_FragCoord.xy);\n"
+	"	float chromaw = floor((size.x + 1.0) / 2.0);\n"
+	"	vec3 rgb, coeffs;\n"
+	"	float offset = 0.0;\n"
+	"\n"
+	"	if(pos.y < size.y)\n"
+	"	{\n"
+	"		rgb = fetch(vec2(pos.x, size.y - 1.0 - pos.y));\n"
+	"		coeffs = vec3(0.299, 0.587, 0.114);\n"
+	"	}\n"
+	"	else\n"
+	"	{\n"
+	"		bool v = pos.x >= chromaw;\n"
+	"		vec2 p = vec2((v ? pos.x - chromaw : pos.x) * 2.0,\n"
+	"			size.y - 2.0 - (pos.y - size.y) * 2.0);\n"
+	"		rgb = (fetch(p) + fetch(p + vec2(1.0, 0.0)) + fetch(p + vec2(0.0, 1.0))\n"
+	"			+ fetch(p + vec2(1.0, 1.0))) * 0.25;\n"
+	"		coeffs = v ? vec3(0.5, -0.418688, -0.081312) :\n"
+	"			vec3(-0.168736, -0.331264, 0.5);\n"
+	"		offset = 128.0 / 255.0;\n"
+	"	}\n"
+	"	gl_FragColor = vec4(dot(rgb, coeffs) + offset, 0.0, 0.0, 1.0);\n"
+	"}\n";
+
+
+// Returns false if GPU-side color conversion is not supported, in which case
+// the caller should fall back to reading back RGB pixels.
+bool VirtualDrawable::readPixelsYUV(GLint width, GLint height, GLubyte *bits,
+	GLint readBuf, GLfloat gamma)
+{
+	GLint dstWidth = (width + 1) / 2 * 2, dstHeight = height + (height + 1) / 2;
+
+	if(!bits || width < 1 || height < 1) THROW("Invalid argument");
+
+	if(!checkRenderMode()) return true;
+	resetDiff();
+
+	if(!ctx)
+	{
+		if(!isInit())
+			THROW("VirtualDrawable instance has not been fully initialized");
+		if((ctx = _glXCreateNewContext(DPY3D, config, GLX_RGBA_TYPE, NULL,
+			direct)) == 0)
+			THROW("Could not create OpenGL context for readback");
+	}
+	TempContext tc(DPY3D, getGLXDrawable(), getGLXDrawable(), ctx, config,
+		GLX_RGBA_TYPE);
+
+	if(!ext) ext = (const char *)_glGetString(GL_EXTENSIONS);
+	if(!ext || !strstr(ext, "GL_ARB_framebuffer_object")
+		|| !strstr(ext, "GL_ARB_texture_rg")
+		|| !strstr(ext, "GL_ARB_fragment_shader"))
+	{
+		if(!alreadyWarnedYUV && fconfig.verbose)
+		{
+			vglout.println("[VGL] NOTICE: GPU-side YUV conversion requires the GL_ARB_framebuffer_object,");
+			vglout.println("[VGL]    GL_ARB_texture_rg, and GL_ARB_fragment_shader extensions.  Using RGB");
+			vglout.println("[VGL]    readback instead.");
+			alreadyWarnedYUV = true;
+		}
+		return false;
+	}
+	if(yuvCtx != ctx)
+	{
+		// The context that owned the conversion resources has been destroyed.
+		yuvTex[0] = yuvTex[1] = yuvFBO = yuvProgram = 0;
+		yuvWidth = yuvHeight = -1;
+		yuvCtx = ctx;
+	}
+
+	if(!yuvProgram)
+	{
+		GLuint program = buildProgram(yuvShaderSource);
+		_glUseProgram(program);
+		_glUniform1i(_glGetUniformLocation(program, "src"), 0);
+		_glUseProgram(0);
+		yuvSizeLoc = _glGetUniformLocation(program, "size");
+		yuvGammaLoc = _glGetUniformLocation(program, "gamma");
+		yuvProgram = program;
+	}
+	if(!yuvFBO)
+	{
+		_glGenTextures(2, yuvTex);
+		_glGenFramebuffers(1, &yuvFBO);
+		if(!yuvTex[0] || !yuvTex[1] || !yuvFBO)
+			THROW("Could not create YUV conversion framebuffer");
+	}
+	if(width != yuvWidth || height != yuvHeight)
+	{
+		_glBindTexture(GL_TEXTURE_2D, yuvTex[0]);
+		_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		_glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+			GL_UNSIGNED_BYTE, NULL);
+		_glBindTexture(GL_TEXTURE_2D, yuvTex[1]);
+		_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		_glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, dstWidth, dstHeight, 0, GL_RED,
+			GL_UNSIGNED_BYTE, NULL);
+		_glBindTexture(GL_TEXTURE_2D, 0);
+		_glBindFramebuffer(GL_FRAMEBUFFER, yuvFBO);
+		_glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			GL_TEXTURE_2D, yuvTex[1], 0);
+		GLenum status = _glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		_glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if(status != GL_FRAMEBUFFER_COMPLETE)
+			THROW("YUV conversion framebuffer is incomplete");
+		yuvWidth = width;  yuvHeight = height;
+	}
+
+	if(!alreadyPrinted && fconfig.verbose)
+	{
+		vglout.println("[VGL] Using GPU-side color conversion for readback (%s --> YUV 4:2:0)",
+			formatString(oglDraw->getFormat()));
+		alreadyPrinted = true;
+	}
+
+	int e = _glGetError();
+	while(e != GL_NO_ERROR) e = _glGetError();  // Clear previous error
+	profReadback.startFrame();
+
+	_glReadBuffer(readBuf);
+	_glBindTexture(GL_TEXTURE_2D, yuvTex[0]);
+	_glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+	_glBindFramebuffer(GL_FRAMEBUFFER, yuvFBO);
+	_glViewport(0, 0, dstWidth, dstHeight);
+	_glUseProgram(yuvProgram);
+	_glUniform2f(yuvSizeLoc, (GLfloat)width, (GLfloat)height);
+	_glUniform1f(yuvGammaLoc, gamma);
+	_glRecti(-1, -1, 1, 1);
+	_glUseProgram(0);
+	_glBindTexture(GL_TEXTURE_2D, 0);
+
+	if(dstWidth % 8 == 0) _glPixelStorei(GL_PACK_ALIGNMENT, 8);
+	else if(dstWidth % 4 == 0) _glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	else _glPixelStorei(GL_PACK_ALIGNMENT, 2);
+	_glReadPixels(0, 0, dstWidth, dstHeight, GL_RED, GL_UNSIGNED_BYTE, bits);
+	_glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	profReadback.endFrame(width * height, 0, 1);
+	CHECKGL("Read Pixels");
+	return true;
 }
 
 
@@ -549,3 +1130,291 @@ void VirtualDrawable::copyPixels(GLint srcX, GLint srcY, GLint width,
 	_glMatrixMode(GL_PROJECTION);
 	_glPopMatrix();
 }
+
+
+// GPU-side frame differencing.  The frame is copied into one of two textures,
+// and a two-pass shader compares it with the previous frame (which is in the
+// other texture.)  The first pass reduces each DIFFCELL-pixel-wide span of
+// each row to one byte, and the second pass reduces each DIFFCELL-row-high
+// column of spans to one byte, so the mask that is read back has one byte per
+// DIFFCELL x DIFFCELL cell (nonzero = changed.)
+
+#define DIFFCELL  64
+#define DIFFCELLSTR2(c)  #c
+#define DIFFCELLSTR(c)  DIFFCELLSTR2(c)
+
+static const GLchar *diffRowShaderSource =
+	"#define CELL " DIFFCELLSTR(DIFFCELL) "\n"
+	"uniform sampler2D cur, prev;\n"
+	"uniform vec2 size;\n"
+	"\n"
+	"void main(void)\n"
+	"{\n"
+	"	vec2 pos = floor(gl_FragCoord.xy);\n"
+	"	float changed = 0.0;\n"
+	"\n"
+	"	for(int i = 0; i < CELL; i++)\n"
+	"	{\n"
+	"		float x = pos.x * float(CELL) + float(i);\n"
+	"		if(x >= size.x) break;\n"
+	"		vec2 tc = (vec2(x, pos.y) + 0.5) / size;\n"
+	"		if(any(notEqual(texture2D(cur, tc), texture2D(prev, tc))))\n"
+	"		{\n"
+	"			changed = 1.0;  break;\n"
+	"		}\n"
+	"	}\n"
+	"	gl_FragColor = vec4(changed, 0.0, 0.0, 1.0);\n"
+	"}\n";
+
+static const GLchar *diffCellShaderSource =
+	"#define CELL " DIFFCELLSTR(DIFFCELL) "\n"
+	"uniform sampler2D rows;\n"
+	"uniform vec2 size;\n"
+	"\n"
+	"void main(void)\n"
+	"{\n"
+	"	vec2 pos = floor(gl_FragCoord.xy);\n"
+	"	float changed = 0.0;\n"
+	"\n"
+	"	for(int i = 0; i < CELL; i++)\n"
+	"	{\n"
+	"		float y = pos.y * float(CELL) + float(i);\n"
+	"		if(y >= size.y) break;\n"
+	"		if(texture2D(rows, (vec2(pos.x, y) + 0.5) / size).r > 0.5)\n"
+	"		{\n"
+	"			changed = 1.0;  break;\n"
+	"		}\n"
+	"	}\n"
+	"	gl_FragColor = vec4(changed, 0.0, 0.0, 1.0);\n"
+	"}\n";
+
+
+// Any readback that bypasses readPixelsDiff() leaves the tracked buffers (and
+// possibly the previous frame texture) out of sync with the rendered frames, so
+// the next differenced readback must start over with a full frame.
+void VirtualDrawable::resetDiff(void)
+{
+	for(int i = 0; i < NDIFFBUFS; i++) diffBufs[i].bits = NULL;
+	diffPrevValid = false;
+}
+
+
+// Read back only the cells that have changed since the specified buffer last
+// received a frame.  Returns false if GPU-side frame differencing is not
+// supported, in which case the caller should fall back to readPixels().
+bool VirtualDrawable::readPixelsDiff(GLint width, GLint pitch, GLint height,
+	GLenum glFormat, PF *pf, GLubyte *bits, GLint readBuf)
+{
+	GLenum type = GL_UNSIGNED_BYTE;
+	int cols = (width + DIFFCELL - 1) / DIFFCELL,
+		rows = (height + DIFFCELL - 1) / DIFFCELL, i, j;
+
+	if(glFormat == GL_NONE)
+	{
+		glFormat = pf_glformat[pf->id];  type = pf_gldatatype[pf->id];
+	}
+	if(glFormat == GL_NONE) THROW("Unsupported pixel format");
+	if(!bits || width < 1 || height < 1 || pitch % pf->size)
+		THROW("Invalid argument");
+
+	if(!checkRenderMode()) return true;
+
+	if(!ctx)
+	{
+		if(!isInit())
+			THROW("VirtualDrawable instance has not been fully initialized");
+		if((ctx = _glXCreateNewContext(DPY3D, config, GLX_RGBA_TYPE, NULL,
+			direct)) == 0)
+			THROW("Could not create OpenGL context for readback");
+	}
+	TempContext tc(DPY3D, getGLXDrawable(), getGLXDrawable(), ctx, config,
+		GLX_RGBA_TYPE);
+
+	if(!ext) ext = (const char *)_glGetString(GL_EXTENSIONS);
+	if(!ext || !strstr(ext, "GL_ARB_framebuffer_object")
+		|| !strstr(ext, "GL_ARB_texture_rg")
+		|| !strstr(ext, "GL_ARB_fragment_shader"))
+	{
+		if(!alreadyWarnedDiff && fconfig.verbose)
+		{
+			vglout.println("[VGL] NOTICE: GPU-side frame differencing requires the GL_ARB_framebuffer_object,");
+			vglout.println("[VGL]    GL_ARB_texture_rg, and GL_ARB_fragment_shader extensions.  Using PBO");
+			vglout.println("[VGL]    readback instead.");
+			alreadyWarnedDiff = true;
+		}
+		return false;
+	}
+	if(diffCtx != ctx)
+	{
+		// The context that owned the differencing resources has been destroyed.
+		memset(diffTex, 0, sizeof(diffTex));  memset(diffFBO, 0, sizeof(diffFBO));
+		memset(diffProgram, 0, sizeof(diffProgram));
+		diffWidth = diffHeight = -1;
+		diffCtx = ctx;
+	}
+
+	if(!diffProgram[0] || !diffProgram[1])
+	{
+		GLuint rowProgram = buildProgram(diffRowShaderSource),
+			cellProgram = buildProgram(diffCellShaderSource);
+		_glUseProgram(rowProgram);
+		_glUniform1i(_glGetUniformLocation(rowProgram, "cur"), 0);
+		_glUniform1i(_glGetUniformLocation(rowProgram, "prev"), 1);
+		_glUseProgram(cellProgram);
+		_glUniform1i(_glGetUniformLocation(cellProgram, "rows"), 0);
+		_glUseProgram(0);
+		diffRowSizeLoc = _glGetUniformLocation(rowProgram, "size");
+		diffCellSizeLoc = _glGetUniformLocation(cellProgram, "size");
+		diffProgram[0] = rowProgram;  diffProgram[1] = cellProgram;
+	}
+	if(!diffFBO[0])
+	{
+		_glGenTextures(4, diffTex);
+		_glGenFramebuffers(2, diffFBO);
+		if(!diffTex[0] || !diffTex[1] || !diffTex[2] || !diffTex[3]
+			|| !diffFBO[0] || !diffFBO[1])
+			THROW("Could not create frame differencing framebuffers");
+	}
+	if(width != diffWidth || height != diffHeight)
+	{
+		// diffTex[0] and diffTex[1] hold the current and previous frames,
+		// diffTex[2] holds the per-row spans, and diffTex[3] holds the mask.
+		for(i = 0; i < 4; i++)
+		{
+			_glBindTexture(GL_TEXTURE_2D, diffTex[i]);
+			_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			if(i < 2)
+				_glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+					GL_UNSIGNED_BYTE, NULL);
+			else
+				_glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, cols, i == 2 ? height : rows,
+					0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+		}
+		_glBindTexture(GL_TEXTURE_2D, 0);
+		for(i = 0; i < 2; i++)
+		{
+			_glBindFramebuffer(GL_FRAMEBUFFER, diffFBO[i]);
+			_glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+				GL_TEXTURE_2D, diffTex[i + 2], 0);
+			GLenum status = _glCheckFramebufferStatus(GL_FRAMEBUFFER);
+			_glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			if(status != GL_FRAMEBUFFER_COMPLETE)
+				THROW("Frame differencing framebuffer is incomplete");
+		}
+		delete [] diffMask;  diffMask = NULL;
+		NEWCHECK(diffMask = new unsigned char[cols * rows]);
+		for(i = 0; i < NDIFFBUFS; i++)
+		{
+			delete [] diffBufs[i].damage;  diffBufs[i].damage = NULL;
+			NEWCHECK(diffBufs[i].damage = new unsigned char[cols * rows]);
+		}
+		diffWidth = width;  diffHeight = height;  diffCols = cols;  diffRows = rows;
+		resetDiff();
+	}
+	if(pitch != diffPitch || glFormat != diffFormat)
+	{
+		diffPitch = pitch;  diffFormat = glFormat;
+		resetDiff();
+	}
+
+	if(!alreadyPrinted && fconfig.verbose)
+	{
+		vglout.println("[VGL] Using GPU-side frame differencing for readback (%s --> %s)",
+			formatString(oglDraw->getFormat()), formatString(glFormat));
+		alreadyPrinted = true;
+	}
+
+	int e = _glGetError();
+	while(e != GL_NO_ERROR) e = _glGetError();  // Clear previous error
+	profReadback.startFrame();
+
+	// Copy the frame into a texture, and compare it with the previous frame.
+	_glReadBuffer(readBuf);
+	_glBindTexture(GL_TEXTURE_2D, diffTex[diffCur]);
+	_glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+	if(diffPrevValid)
+	{
+		_glActiveTexture(GL_TEXTURE1);
+		_glBindTexture(GL_TEXTURE_2D, diffTex[diffCur ^ 1]);
+		_glActiveTexture(GL_TEXTURE0);
+		_glBindFramebuffer(GL_FRAMEBUFFER, diffFBO[0]);
+		_glViewport(0, 0, cols, height);
+		_glUseProgram(diffProgram[0]);
+		_glUniform2f(diffRowSizeLoc, (GLfloat)width, (GLfloat)height);
+		_glRecti(-1, -1, 1, 1);
+		_glActiveTexture(GL_TEXTURE1);
+		_glBindTexture(GL_TEXTURE_2D, 0);
+		_glActiveTexture(GL_TEXTURE0);
+
+		_glBindTexture(GL_TEXTURE_2D, diffTex[2]);
+		_glBindFramebuffer(GL_FRAMEBUFFER, diffFBO[1]);
+		_glViewport(0, 0, cols, rows);
+		_glUseProgram(diffProgram[1]);
+		_glUniform2f(diffCellSizeLoc, (GLfloat)cols, (GLfloat)height);
+		_glRecti(-1, -1, 1, 1);
+		_glUseProgram(0);
+
+		_glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		_glReadPixels(0, 0, cols, rows, GL_RED, GL_UNSIGNED_BYTE, diffMask);
+		_glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	else memset(diffMask, 1, cols * rows);
+	_glBindTexture(GL_TEXTURE_2D, 0);
+	diffCur ^= 1;  diffPrevValid = true;
+
+	// Frames can be spoiled, so a transport frame buffer may have missed any
+	// number of intervening frames.  Thus, the changes are accumulated into
+	// the damage map of every tracked buffer, and the buffer that is being
+	// filled receives all of the cells that have changed since it was last
+	// filled.  An untracked buffer receives the whole frame.
+	DiffBuffer *buf = NULL, *lru = &diffBufs[0];
+	for(i = 0; i < NDIFFBUFS; i++)
+	{
+		DiffBuffer &b = diffBufs[i];
+		if(b.bits)
+		{
+			for(j = 0; j < cols * rows; j++) b.damage[j] |= diffMask[j];
+		}
+		if(b.bits == bits) buf = &b;
+		if(lru->bits && (!b.bits || b.lastUsed < lru->lastUsed)) lru = &b;
+	}
+	if(!buf)
+	{
+		buf = lru;  buf->bits = bits;
+		memset(buf->damage, 1, cols * rows);
+	}
+	buf->lastUsed = ++diffCount;
+
+	if(pitch % 8 == 0) _glPixelStorei(GL_PACK_ALIGNMENT, 8);
+	else if(pitch % 4 == 0) _glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	else if(pitch % 2 == 0) _glPixelStorei(GL_PACK_ALIGNMENT, 2);
+	else if(pitch % 1 == 0) _glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	_glPixelStorei(GL_PACK_ROW_LENGTH, pitch / pf->size);
+
+	// Each horizontal run of damaged cells is read back with one call.  The
+	// frame is bottom-up, so the rows in memory match the rows in OpenGL.
+	long pixels = 0;
+	for(j = 0; j < rows; j++)
+	{
+		unsigned char *damage = &buf->damage[cols * j];
+		int y = j * DIFFCELL, h = min(DIFFCELL, height - y);
+
+		for(i = 0; i < cols; i++)
+		{
+			if(!damage[i]) continue;
+			int x = i * DIFFCELL;
+			while(i < cols && damage[i]) i++;
+			int w = min(i * DIFFCELL, width) - x;
+			_glReadPixels(x, y, w, h, glFormat, type,
+				&bits[pitch * y + pf->size * x]);
+			pixels += w * h;
+		}
+	}
+	_glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+	memset(buf->damage, 0, cols * rows);
+
+	profReadback.endFrame(pixels, 0, 1);
+	CHECKGL("Read Pixels");
+	return true;
+}
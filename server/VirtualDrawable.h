@@ -87,7 +87,7 @@ namespace vglserver
 			};
 
 			bool checkRenderMode(void);
-			void readPixels(GLint x, GLint y, GLint width, GLint pitch, GLint height,
+			bool readPixels(GLint x, GLint y, GLint width, GLint pitch, GLint height,
 				GLenum glFormat, PF *pf, GLubyte *bits, GLint readBuf, bool stereo);
 
 			vglutil::CriticalSection mutex;
@@ -102,6 +102,110 @@ namespace vglserver
 			GLuint pbo;
 			int numSync, numFrames, lastFormat;
 			bool usePBO;
+
+			// Deferred readback (VGL_READBACK=async.)  Each frame is read back into
+			// the next PBO in a ring, and a fence is inserted behind the readback.
+			// The frame is copied out of the PBO the next time that a frame with
+			// the same geometry and format is read back, so the application does
+			// not wait for the GPU to finish transferring it.  In that case,
+			// readPixels() returns false, and the caller must not send the frame.
+			// Subclasses set deferReadback if they can tolerate the added frame of
+			// latency.  If no new frame is read back within a short period of time,
+			// then the subclass's idle thread calls readPixels() with drainReadback
+			// set, which copies out the pending frame without reading back another
+			// one.  Since one frame is copied out for each frame that is read back,
+			// only two PBOs are ever in use.  The PBOs and fences belong to ringCtx.
+			static const int NPBOS = 2;
+			typedef struct
+			{
+				GLuint pbo;  GLsync fence;
+				GLint x, y, width, pitch, height, readBuf;
+				GLenum glFormat, type;
+			} PBOSlot;
+			bool readPixelsDeferred(GLint x, GLint y, GLint width, GLint pitch,
+				GLint height, GLenum glFormat, GLenum type, GLubyte *bits,
+				GLint readBuf);
+			bool drainPixels(GLint x, GLint y, GLint width, GLint pitch,
+				GLint height, GLenum glFormat, GLenum type, GLubyte *bits,
+				GLint readBuf);
+			bool readbackPending(void);
+			void copyPBO(PBOSlot &slot, GLubyte *bits);
+			void releaseFence(PBOSlot &slot);
+			PBOSlot ring[NPBOS];  int ringIndex;
+			GLXContext ringCtx;  int ringConfigID;
+			bool deferReadback, drainReadback, alreadyWarnedSync;
+
+			// The idle thread must not use the application's display connection, so
+			// it copies frames out of the PBOs using its own display connection and
+			// a context (drainCtx) that shares the PBOs and fences with ringCtx.
+			void destroyDrainContext(void);
+			Display *drainDpy;
+			GLXContext drainCtx, drainShareCtx;
+			GLXPbuffer drainPB;
+
+			// Zero-copy readback (VGL_READBACK=map.)  Frames are read back into
+			// persistently mapped PBOs (GL_ARB_buffer_storage), and the mapped PBO
+			// memory is used as the pixel buffer of the image transport's frame, so
+			// the frame is never copied out of the PBO.  Each PBO belongs to the
+			// transport frame that is using it until that frame is complete.  Since
+			// the transport may still be using the PBOs, a context that owns them
+			// is not destroyed until this instance is destroyed.
+			static const int NMAPPEDPBOS = 5;
+			typedef struct
+			{
+				GLuint pbo;  GLubyte *bits;  GLint size;
+				vglcommon::Frame *owner;
+			} MappedPBO;
+			GLubyte *readPixelsMapped(GLint x, GLint y, GLint width, GLint pitch,
+				GLint height, GLenum glFormat, PF *pf, GLint readBuf);
+			void setMappedPBOOwner(GLubyte *bits, vglcommon::Frame *owner);
+			void destroyContext(void);
+			MappedPBO mapped[NMAPPEDPBOS];
+			GLXContext mappedCtx, *retiredCtx;  int nRetiredCtx;
+			bool alreadyWarnedMap;
+
+			// GPU-side color conversion (VGL_GPUYUV.)  The read buffer is copied
+			// into a texture, and a fragment shader converts it into a planar YUV
+			// 4:2:0 image (laid out as described in vglcommon::Frame::initYUV()) in
+			// a single-channel render target, which is then read back.  The
+			// textures, framebuffer object, and shader program belong to yuvCtx.
+			bool readPixelsYUV(GLint width, GLint height, GLubyte *bits,
+				GLint readBuf, GLfloat gamma);
+			GLuint yuvTex[2], yuvFBO, yuvProgram;
+			GLint yuvWidth, yuvHeight, yuvSizeLoc, yuvGammaLoc;
+			GLXContext yuvCtx;
+			bool alreadyWarnedYUV;
+
+			// GPU-side frame differencing (VGL_READBACK=diff.)  Each frame is
+			// copied into one of two textures and compared with the previous frame
+			// (in the other texture) by two shader passes, which produce a mask
+			// with one byte per cell of the frame.  Only the mask and the changed
+			// cells are read back.  A transport frame buffer retains the pixels from
+			// the last time that it was read back into, so the cells that have
+			// changed since then (its damage) are tracked separately for each of
+			// the NDIFFBUFS most recently used buffers.  A buffer that is not
+			// tracked is read back in its entirety.  Any other type of readback
+			// invalidates the tracking (see resetDiff().)  The textures, framebuffer
+			// objects, and shader programs belong to diffCtx.
+			static const int NDIFFBUFS = 4;
+			typedef struct
+			{
+				GLubyte *bits;  unsigned char *damage;
+				unsigned int lastUsed;
+			} DiffBuffer;
+			bool readPixelsDiff(GLint width, GLint pitch, GLint height,
+				GLenum glFormat, PF *pf, GLubyte *bits, GLint readBuf);
+			void resetDiff(void);
+			DiffBuffer diffBufs[NDIFFBUFS];
+			unsigned char *diffMask;
+			GLuint diffTex[4], diffFBO[2], diffProgram[2];
+			GLint diffWidth, diffHeight, diffPitch, diffCols, diffRows;
+			GLint diffRowSizeLoc, diffCellSizeLoc;
+			GLenum diffFormat;
+			int diffCur;  unsigned int diffCount;
+			bool diffPrevValid;
+			GLXContext diffCtx;
+			bool alreadyWarnedDiff;
 			bool alreadyPrinted, alreadyWarned, alreadyWarnedRenderMode;
 			const char *ext;
 	};
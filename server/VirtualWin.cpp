@@ -40,6 +40,10 @@ static const int trans2pf[RRTRANS_FORMATOPT] =
 #define IS_PASSIVE(mode) \
 	(mode >= RRSTEREO_INTERLEAVED && mode <= RRSTEREO_SIDEBYSIDE)
 
+// A deferred frame is sent by the flusher thread if no new frame is read back
+// within this many seconds (see VGL_READBACK=async.)
+#define DEFER_IDLE  0.05
+
 
 // This class encapsulates the 3D off-screen drawable, its most recent
 // ancestor, and information specific to its corresponding X window
@@ -67,6 +71,9 @@ VirtualWin::VirtualWin(Display *dpy_, Window win) :
 	newConfig = false;
 	swapInterval = 0;
 	alreadyWarnedPluginRenderMode = false;
+	flusher = NULL;  fthread = NULL;
+	deferDrawBuf = GL_BACK;  deferStereoMode = RRSTEREO_LEYE;
+	deferCompress = RRCOMP_JPEG;
 	XWindowAttributes xwa;
 	if(!XGetWindowAttributes(dpy, win, &xwa) || !xwa.visual)
 		throw(vglutil::Error(__FUNCTION__, "Invalid window", -1));
@@ -86,6 +93,14 @@ VirtualWin::VirtualWin(Display *dpy_, Window win) :
 
 VirtualWin::~VirtualWin(void)
 {
+	// The flusher thread must be shut down before the mutex is locked, since it
+	// locks the mutex in order to send a deferred frame.
+	if(fthread)
+	{
+		flusher->shutdown();  fthread->stop();
+		delete fthread;  fthread = NULL;
+	}
+	delete flusher;  flusher = NULL;
 	mutex.lock(false);
 	delete oldDraw;  oldDraw = NULL;
 	delete x11trans;  x11trans = NULL;
@@ -265,6 +280,14 @@ void VirtualWin::readback(GLint drawBuf, bool spoilLast, bool sync)
 	int compress = fconfig.compress;
 	if(sync && strlen(fconfig.transport) == 0) compress = RRCOMP_PROXY;
 
+	// If the application is waiting for the frame to be displayed, then it
+	// cannot be deferred (see VGL_READBACK=async.)  Deferred frames may be sent
+	// by the flusher thread, which cannot use the application's display
+	// connection, so frames are deferred only when using the VGL Transport.
+	deferReadback = !sync && strlen(fconfig.transport) == 0
+		&& (compress == RRCOMP_JPEG || compress == RRCOMP_RGB
+			|| compress == RRCOMP_YUV);
+
 	if(isStereo() && stereoMode != RRSTEREO_LEYE && stereoMode != RRSTEREO_REYE)
 	{
 		if(DrawingToRight() || rdirty) doStereo = true;
@@ -330,6 +353,18 @@ void VirtualWin::readback(GLint drawBuf, bool spoilLast, bool sync)
 			}
 			sendVGL(drawBuf, spoilLast, doStereo, stereoMode, compress, fconfig.qual,
 				fconfig.subsamp);
+			if(deferReadback && readbackPending())
+			{
+				deferDrawBuf = drawBuf;  deferStereoMode = stereoMode;
+				deferCompress = compress;
+				if(!fthread)
+				{
+					NEWCHECK(flusher = new Flusher(this));
+					NEWCHECK(fthread = new Thread(flusher));
+					fthread->start();
+				}
+				flusher->frameDeferred();
+			}
 			break;
 		#ifdef USEXV
 		case RRCOMP_XV:
@@ -486,9 +521,48 @@ void VirtualWin::sendVGL(GLint drawBuf, bool spoilLast, bool doStereo,
 	}
 
 	if(!fconfig.spoil) vglconn->synchronize();
-	ERRIFNOT(f = vglconn->getFrame(w, h, pixelFormat, FRAME_BOTTOMUP,
-		doStereo && stereoMode == RRSTEREO_QUADBUF));
-	if(doStereo && IS_ANAGLYPHIC(stereoMode))
+
+	// With GPU-side color conversion, the frame is read back as planar YUV
+	// 4:2:0, which the compressors can use without further conversion.
+	// A deferred frame is always copied out of a PBO (see flushDeferred().)
+	f = NULL;
+	if(fconfig.gpuyuv && !doStereo && !fconfig.logo && !drainReadback
+		&& (compress == RRCOMP_YUV || (compress == RRCOMP_JPEG && subsamp >= 4)))
+	{
+		ERRIFNOT(f = vglconn->getYUVFrame(w, h));
+		if(!readYUV(f, drawBuf, stereoMode))
+		{
+			f->signalComplete();  f = NULL;
+		}
+	}
+
+	// With zero-copy readback, the frame is read back before a transport frame
+	// is obtained, and the PBO into which it was read back becomes the transport
+	// frame's pixel buffer.
+	GLubyte *mappedBits = NULL;
+	bool haveFrame = true;
+	if(!f && fconfig.readback == RRREAD_MAP && !doStereo && !drainReadback)
+	{
+		GLint readBuf = drawBuf;
+		if(stereoMode == RRSTEREO_LEYE) readBuf = LEYE(drawBuf);
+		if(stereoMode == RRSTEREO_REYE) readBuf = REYE(drawBuf);
+		PF *pf = pf_get(pixelFormat);
+		mappedBits = readPixelsMapped(0, 0, w, w * pf->size, h, glFormat, pf,
+			readBuf);
+		if(mappedBits) correctGamma(w, w * pf->size, h, pf, mappedBits, false);
+	}
+
+	if(!f)
+	{
+		ERRIFNOT(f = vglconn->getFrame(w, h, pixelFormat, FRAME_BOTTOMUP,
+			doStereo && stereoMode == RRSTEREO_QUADBUF, mappedBits));
+	}
+	if(f->chroma[0] || mappedBits)
+	{
+		if(mappedBits) setMappedPBOOwner(mappedBits, f);
+		rFrame.deInit();  gFrame.deInit();  bFrame.deInit();  stereoFrame.deInit();
+	}
+	else if(doStereo && IS_ANAGLYPHIC(stereoMode))
 	{
 		stereoFrame.deInit();
 		makeAnaglyph(f, drawBuf, stereoMode);
@@ -504,11 +578,23 @@ void VirtualWin::sendVGL(GLint drawBuf, bool spoilLast, bool doStereo,
 		GLint readBuf = drawBuf;
 		if(doStereo || stereoMode == RRSTEREO_LEYE) readBuf = LEYE(drawBuf);
 		if(stereoMode == RRSTEREO_REYE) readBuf = REYE(drawBuf);
-		readPixels(0, 0, f->hdr.framew, f->pitch, f->hdr.frameh, glFormat, f->pf,
-			f->bits, readBuf, doStereo);
-		if(doStereo && f->rbits)
-			readPixels(0, 0, f->hdr.framew, f->pitch, f->hdr.frameh, glFormat, f->pf,
-				f->rbits, REYE(drawBuf), doStereo);
+		// With GPU-side frame differencing, only the cells that have changed
+		// since the frame buffer was last used are read back.  Software gamma
+		// correction and the logo modify the pixels after readback, so they
+		// require a full readback.
+		if(fconfig.readback != RRREAD_DIFF || doStereo || fconfig.logo
+			|| drainReadback
+			|| (fconfig.gamma != 0.0 && fconfig.gamma != 1.0
+				&& fconfig.gamma != -1.0)
+			|| !readPixelsDiff(f->hdr.framew, f->pitch, f->hdr.frameh, glFormat,
+				f->pf, f->bits, readBuf))
+		{
+			haveFrame = readPixels(0, 0, f->hdr.framew, f->pitch, f->hdr.frameh,
+				glFormat, f->pf, f->bits, readBuf, doStereo);
+			if(doStereo && f->rbits)
+				readPixels(0, 0, f->hdr.framew, f->pitch, f->hdr.frameh, glFormat,
+					f->pf, f->rbits, REYE(drawBuf), doStereo);
+		}
 	}
 	f->hdr.winid = x11Draw;
 	f->hdr.framew = f->hdr.width;
@@ -519,6 +605,12 @@ void VirtualWin::sendVGL(GLint drawBuf, bool spoilLast, bool doStereo,
 	f->hdr.subsamp = subsamp;
 	f->hdr.compress = (unsigned char)compress;
 	if(!syncdpy) { XSync(dpy, False);  syncdpy = true; }
+	if(!haveFrame)
+	{
+		// The frame was deferred, so it will be sent with the next frame or by
+		// the flusher thread.
+		f->signalComplete();  return;
+	}
 	if(fconfig.logo) f->addLogo();
 	vglconn->sendFrame(f);
 }
@@ -584,9 +676,19 @@ void VirtualWin::sendXV(GLint drawBuf, bool spoilLast, bool sync,
 	else if(glFormat == GL_BGR) pixelFormat = PF_BGR;
 	else if(glFormat == GL_BGRA) pixelFormat = PF_BGRX;
 
-	frame.init(hdr, pixelFormat, FRAME_BOTTOMUP, false);
+	bool yuv = false;
+	if(fconfig.gpuyuv && !doStereo && !fconfig.logo)
+	{
+		frame.initYUV(hdr);
+		yuv = readYUV(&frame, drawBuf, stereoMode);
+	}
+	if(!yuv) frame.init(hdr, pixelFormat, FRAME_BOTTOMUP, false);
 
-	if(doStereo && IS_ANAGLYPHIC(stereoMode))
+	if(yuv)
+	{
+		rFrame.deInit();  gFrame.deInit();  bFrame.deInit();  stereoFrame.deInit();
+	}
+	else if(doStereo && IS_ANAGLYPHIC(stereoMode))
 	{
 		stereoFrame.deInit();
 		makeAnaglyph(&frame, drawBuf, stereoMode);
@@ -658,13 +760,81 @@ void VirtualWin::makePassive(Frame *f, int drawBuf, GLenum glFormat,
 }
 
 
-void VirtualWin::readPixels(GLint x, GLint y, GLint width, GLint pitch,
+bool VirtualWin::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 	GLint height, GLenum glFormat, PF *pf, GLubyte *bits, GLint buf, bool stereo)
 {
-	VirtualDrawable::readPixels(x, y, width, pitch, height, glFormat, pf, bits,
-		buf, stereo);
+	if(!VirtualDrawable::readPixels(x, y, width, pitch, height, glFormat, pf,
+		bits, buf, stereo))
+		return false;
+	correctGamma(width, pitch, height, pf, bits, stereo);
+	return true;
+}
 
-	// Gamma correction
+
+// Send the frame that was deferred by the last readback, if it has not already
+// been sent.  This is called by the flusher thread.  The frame is sent using
+// the same code path as a frame that is read back, except that VirtualDrawable
+// copies the deferred frame out of its PBO instead of reading back a new one.
+void VirtualWin::flushDeferred(void)
+{
+	CriticalSection::SafeLock l(mutex);
+	if(doWMDelete || !vglconn || !readbackPending()) return;
+	drainReadback = true;
+	try
+	{
+		sendVGL(deferDrawBuf, false, false, deferStereoMode, deferCompress,
+			fconfig.qual, fconfig.subsamp);
+	}
+	catch(...)
+	{
+		drainReadback = false;  throw;
+	}
+	drainReadback = false;
+}
+
+
+void VirtualWin::Flusher::run(void)
+{
+	try
+	{
+		while(!deadYet)
+		{
+			deferred.wait();
+			// Restart the idle period whenever another frame is deferred.
+			while(!deadYet && deferred.timedWait(DEFER_IDLE)) {}
+			if(deadYet) break;
+			parent->flushDeferred();
+		}
+	}
+	catch(Error &e)
+	{
+		// Deferred frames are still sent when the next frame is read back.
+		deadYet = true;
+		vglout.println("[VGL] WARNING: Could not send deferred frame:");
+		vglout.println("[VGL]    %s", e.getMessage());
+	}
+}
+
+
+// Read back a planar YUV frame using GPU-side color conversion (which also
+// performs gamma correction.)  Returns false if the GPU does not support it.
+bool VirtualWin::readYUV(Frame *f, GLint drawBuf, int stereoMode)
+{
+	GLint readBuf = drawBuf;
+	GLfloat gamma = 1.0f;
+
+	if(stereoMode == RRSTEREO_REYE) readBuf = REYE(drawBuf);
+	else if(stereoMode == RRSTEREO_LEYE) readBuf = LEYE(drawBuf);
+	if(fconfig.gamma != 0.0 && fconfig.gamma != 1.0 && fconfig.gamma != -1.0)
+		gamma = (GLfloat)(fconfig.gamma > 0.0 ?
+			1.0 / fconfig.gamma : -fconfig.gamma);
+	return readPixelsYUV(f->hdr.framew, f->hdr.frameh, f->bits, readBuf, gamma);
+}
+
+
+void VirtualWin::correctGamma(GLint width, GLint pitch, GLint height, PF *pf,
+	GLubyte *bits, bool stereo)
+{
 	if(fconfig.gamma != 0.0 && fconfig.gamma != 1.0 && fconfig.gamma != -1.0)
 	{
 		profGamma.startFrame();
@@ -673,38 +843,11 @@ void VirtualWin::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 		{
 			first = false;
 			if(fconfig.verbose)
-				vglout.println("[VGL] Using software gamma correction (correction factor=%f)\n",
-					fconfig.gamma);
-		}
-		if(pf->bpc == 10)
-		{
-			int h = height;
-			while(h--)
-			{
-				int w = width;
-				unsigned int *srcPixel = (unsigned int *)bits;
-				while(w--)
-				{
-					unsigned int r =
-						fconfig.gamma_lut10[(*srcPixel >> pf->rshift) & 1023];
-					unsigned int g =
-						fconfig.gamma_lut10[(*srcPixel >> pf->gshift) & 1023];
-					unsigned int b =
-						fconfig.gamma_lut10[(*srcPixel >> pf->bshift) & 1023];
-					*srcPixel++ =
-						(r << pf->rshift) | (g << pf->gshift) | (b << pf->bshift);
-				}
-				bits += pitch;
-			}
-		}
-		else
-		{
-			unsigned short *ptr1, *ptr2 = (unsigned short *)(&bits[pitch * height]);
-			for(ptr1 = (unsigned short *)bits; ptr1 < ptr2; ptr1++)
-				*ptr1 = fconfig.gamma_lut16[*ptr1];
-			if((pitch * height) % 2 != 0)
-				bits[pitch * height - 1] = fconfig.gamma_lut[bits[pitch * height - 1]];
+				vglout.println("[VGL] Using software gamma correction (correction factor=%f, SIMD=%s)\n",
+					fconfig.gamma, pf_gammainit(PF_GAMMA_AUTO));
 		}
+		pf_gamma(pf, bits, width, pitch, height, fconfig.gamma_lut,
+			fconfig.gamma_lut16, fconfig.gamma_lut10);
 		profGamma.endFrame(width * height, 0, stereo ? 0.5 : 1);
 	}
 }
@@ -53,8 +53,11 @@ namespace vglserver
 		private:
 
 			int init(int w, int h, GLXFBConfig config);
-			void readPixels(GLint x, GLint y, GLint width, GLint pitch, GLint height,
+			bool readPixels(GLint x, GLint y, GLint width, GLint pitch, GLint height,
 				GLenum glFormat, PF *pf, GLubyte *bits, GLint buf, bool stereo);
+			void correctGamma(GLint width, GLint pitch, GLint height, PF *pf,
+				GLubyte *bits, bool stereo);
+			bool readYUV(vglcommon::Frame *f, GLint drawBuf, int stereoMode);
 			void makeAnaglyph(vglcommon::Frame *f, int drawBuf, int stereoMode);
 			void makePassive(vglcommon::Frame *f, int drawBuf, GLenum glFormat,
 				int stereoMode);
@@ -69,6 +72,7 @@ namespace vglserver
 				int stereoMode);
 			#endif
 			TempContext *setupPluginTempContext(GLint drawBuf);
+			void flushDeferred(void);
 
 			Display *eventdpy;
 			OGLDrawable *oldDraw;
@@ -88,6 +92,31 @@ namespace vglserver
 			bool newConfig;
 			int swapInterval;
 			bool alreadyWarnedPluginRenderMode;
+
+			// If a frame has been deferred (see VGL_READBACK=async) and no new frame
+			// is read back within DEFER_IDLE seconds, then the flusher thread sends
+			// the deferred frame, so applications that render only in response to
+			// user input display their last frame.  deferDrawBuf, deferStereoMode,
+			// and deferCompress describe the readback that deferred the frame.
+			class Flusher : public vglutil::Runnable
+			{
+				public:
+
+					Flusher(VirtualWin *parent_) : parent(parent_), deadYet(false) {}
+					void frameDeferred(void) { if(!deadYet) deferred.post(); }
+					void shutdown(void) { deadYet = true;  deferred.post(); }
+
+				private:
+
+					void run(void);
+
+					VirtualWin *parent;
+					vglutil::Semaphore deferred;
+					bool deadYet;
+			};
+
+			Flusher *flusher;  vglutil::Thread *fthread;
+			GLint deferDrawBuf;  int deferStereoMode, deferCompress;
 	};
 }
 
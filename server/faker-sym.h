@@ -285,6 +285,19 @@ extern "C" {
 		return retval; \
 	}
 
+#define VFUNCDEF8(f, at1, a1, at2, a2, at3, a3, at4, a4, at5, a5, at6, a6, \
+	at7, a7, at8, a8, fake_f) \
+	typedef void (*_##f##Type)(at1, at2, at3, at4, at5, at6, at7, at8); \
+	SYMDEF(f); \
+	static INLINE void _##f(at1 a1, at2 a2, at3 a3, at4 a4, at5 a5, at6 a6, \
+		at7 a7, at8 a8) \
+	{ \
+		CHECKSYM(f, fake_f); \
+		DISABLE_FAKER(); \
+		__##f(a1, a2, a3, a4, a5, a6, a7, a8); \
+		ENABLE_FAKER(); \
+	}
+
 #define FUNCDEF9(RetType, f, at1, a1, at2, a2, at3, a3, at4, a4, at5, a5, \
 	at6, a6, at7, a7, at8, a8, at9, a9, fake_f) \
 	typedef RetType (*_##f##Type)(at1, at2, at3, at4, at5, at6, at7, at8, at9); \
@@ -300,6 +313,19 @@ extern "C" {
 		return retval; \
 	}
 
+#define VFUNCDEF9(f, at1, a1, at2, a2, at3, a3, at4, a4, at5, a5, at6, a6, \
+	at7, a7, at8, a8, at9, a9, fake_f) \
+	typedef void (*_##f##Type)(at1, at2, at3, at4, at5, at6, at7, at8, at9); \
+	SYMDEF(f); \
+	static INLINE void _##f(at1 a1, at2 a2, at3 a3, at4 a4, at5 a5, at6 a6, \
+		at7 a7, at8 a8, at9 a9) \
+	{ \
+		CHECKSYM(f, fake_f); \
+		DISABLE_FAKER(); \
+		__##f(a1, a2, a3, a4, a5, a6, a7, a8, a9); \
+		ENABLE_FAKER(); \
+	}
+
 #define FUNCDEF10(RetType, f, at1, a1, at2, a2, at3, a3, at4, a4, at5, a5, \
 	at6, a6, at7, a7, at8, a8, at9, a9, at10, a10, fake_f) \
 	typedef RetType (*_##f##Type)(at1, at2, at3, at4, at5, at6, at7, at8, at9, \
@@ -715,8 +741,16 @@ FUNCDEF1(xcb_generic_event_t *, xcb_wait_for_event, xcb_connection_t *, conn,
 // well as to ensure that, with 'vglrun -nodl', libGL is not loaded into the
 // process until the 3D application actually uses it.
 
+VFUNCDEF1(glActiveTexture, GLenum, texture, NULL)
+
+VFUNCDEF2(glAttachShader, GLuint, program, GLuint, shader, NULL)
+
 VFUNCDEF2(glBindBuffer, GLenum, target, GLuint, buffer, NULL)
 
+VFUNCDEF2(glBindFramebuffer, GLenum, target, GLuint, framebuffer, NULL)
+
+VFUNCDEF2(glBindTexture, GLenum, target, GLuint, texture, NULL)
+
 VFUNCDEF7(glBitmap, GLsizei, width, GLsizei, height, GLfloat, xorig,
 	GLfloat, yorig, GLfloat, xmove, GLfloat, ymove, const GLubyte *, bitmap,
 	NULL)
@@ -724,18 +758,48 @@ VFUNCDEF7(glBitmap, GLsizei, width, GLsizei, height, GLfloat, xorig,
 VFUNCDEF4(glBufferData, GLenum, target, GLsizeiptr, size, const GLvoid *, data,
 	GLenum, usage, NULL)
 
+VFUNCDEF4(glBufferStorage, GLenum, target, GLsizeiptr, size,
+	const GLvoid *, data, GLbitfield, flags, NULL)
+
+FUNCDEF1(GLenum, glCheckFramebufferStatus, GLenum, target, NULL)
+
 VFUNCDEF1(glClear, GLbitfield, mask, NULL)
 
 VFUNCDEF4(glClearColor, GLclampf, red, GLclampf, green, GLclampf, blue,
 	GLclampf, alpha, NULL)
 
+FUNCDEF3(GLenum, glClientWaitSync, GLsync, sync, GLbitfield, flags,
+	GLuint64, timeout, NULL)
+
+VFUNCDEF1(glCompileShader, GLuint, shader, NULL)
+
 VFUNCDEF5(glCopyPixels, GLint, x, GLint, y, GLsizei, width, GLsizei, height,
 	GLenum, type, NULL)
 
+VFUNCDEF8(glCopyTexSubImage2D, GLenum, target, GLint, level, GLint, xoffset,
+	GLint, yoffset, GLint, x, GLint, y, GLsizei, width, GLsizei, height, NULL)
+
+FUNCDEF0(GLuint, glCreateProgram, NULL)
+
+FUNCDEF1(GLuint, glCreateShader, GLenum, type, NULL)
+
+VFUNCDEF2(glDeleteBuffers, GLsizei, n, const GLuint *, buffers, NULL)
+
+VFUNCDEF1(glDeleteSync, GLsync, sync, NULL)
+
 VFUNCDEF0(glEndList, NULL)
 
+FUNCDEF2(GLsync, glFenceSync, GLenum, condition, GLbitfield, flags, NULL)
+
+VFUNCDEF5(glFramebufferTexture2D, GLenum, target, GLenum, attachment,
+	GLenum, textarget, GLuint, texture, GLint, level, NULL)
+
 VFUNCDEF2(glGenBuffers, GLsizei, n, GLuint *, buffers, NULL)
 
+VFUNCDEF2(glGenFramebuffers, GLsizei, n, GLuint *, framebuffers, NULL)
+
+VFUNCDEF2(glGenTextures, GLsizei, n, GLuint *, textures, NULL)
+
 VFUNCDEF3(glGetBufferParameteriv, GLenum, target, GLenum, value, GLint *, data,
 	NULL)
 
@@ -745,10 +809,23 @@ VFUNCDEF2(glGetFloatv, GLenum, pname, GLfloat *, params, NULL)
 
 VFUNCDEF2(glGetIntegerv, GLenum, pname, GLint *, params, NULL)
 
+VFUNCDEF3(glGetProgramiv, GLuint, program, GLenum, pname, GLint *, params,
+	NULL)
+
+VFUNCDEF3(glGetShaderiv, GLuint, shader, GLenum, pname, GLint *, params, NULL)
+
+FUNCDEF2(GLint, glGetUniformLocation, GLuint, program, const GLchar *, name,
+	NULL)
+
+VFUNCDEF1(glLinkProgram, GLuint, program, NULL)
+
 VFUNCDEF0(glLoadIdentity, NULL)
 
 FUNCDEF2(void *, glMapBuffer, GLenum, target, GLenum, access, NULL)
 
+FUNCDEF4(void *, glMapBufferRange, GLenum, target, GLintptr, offset,
+	GLsizeiptr, length, GLbitfield, access, NULL)
+
 VFUNCDEF1(glMatrixMode, GLenum, mode, NULL)
 
 VFUNCDEF2(glNewList, GLuint, list, GLenum, mode, NULL)
@@ -766,11 +843,30 @@ VFUNCDEF2(glRasterPos2i, GLint, x, GLint, y, NULL)
 
 VFUNCDEF1(glReadBuffer, GLenum, mode, NULL)
 
+VFUNCDEF4(glRecti, GLint, x1, GLint, y1, GLint, x2, GLint, y2, NULL)
+
 VFUNCDEF7(glReadPixels, GLint, x, GLint, y, GLsizei, width, GLsizei, height,
 	GLenum, format, GLenum, type, GLvoid *, pixels, NULL)
 
+VFUNCDEF4(glShaderSource, GLuint, shader, GLsizei, count,
+	const GLchar * const *, string, const GLint *, length, NULL)
+
+VFUNCDEF9(glTexImage2D, GLenum, target, GLint, level, GLint, internalformat,
+	GLsizei, width, GLsizei, height, GLint, border, GLenum, format,
+	GLenum, type, const GLvoid *, pixels, NULL)
+
+VFUNCDEF3(glTexParameteri, GLenum, target, GLenum, pname, GLint, param, NULL)
+
+VFUNCDEF2(glUniform1f, GLint, location, GLfloat, v0, NULL)
+
+VFUNCDEF2(glUniform1i, GLint, location, GLint, v0, NULL)
+
+VFUNCDEF3(glUniform2f, GLint, location, GLfloat, v0, GLfloat, v1, NULL)
+
 FUNCDEF1(GLboolean, glUnmapBuffer, GLenum, target, NULL)
 
+VFUNCDEF1(glUseProgram, GLuint, program, NULL)
+
 FUNCDEF0(GLXContext, glXGetCurrentContext, NULL)
 
 // We load all XCB functions dynamically, so that the same VirtualGL binary
@@ -182,6 +182,7 @@ static void fconfig_init(void)
 	fconfig.probeglx = 1;
 	fconfig.qual = DEFQUAL;
 	fconfig.readback = RRREAD_PBO;
+	fconfig.refinequal = 100;
 	fconfig.refreshrate = 60.0;
 	fconfig.samples = -1;
 	fconfig.spoil = 1;
@@ -206,14 +207,10 @@ static void fconfig_buildlut(FakerConfig &fc)
 			fc.gamma_lut[i] = (unsigned char)(255. * pow((double)i / 255., g) + 0.5);
 		for(int i = 0; i < 1024; i++)
 			fc.gamma_lut10[i] =
-				(unsigned short)(1023. * pow((double)i / 1023., g) + 0.5);
+				(unsigned int)(1023. * pow((double)i / 1023., g) + 0.5);
 		for(int i = 0; i < 65536; i++)
-		{
 			fc.gamma_lut16[i] =
-				(unsigned short)(255. * pow((double)(i / 256) / 255., g) + 0.5) << 8;
-			fc.gamma_lut16[i] |=
-				(unsigned short)(255. * pow((double)(i % 256) / 255., g) + 0.5);
-		}
+				(unsigned short)(fc.gamma_lut[i / 256] << 8) | fc.gamma_lut[i % 256];
 	}
 }
 
@@ -276,6 +273,7 @@ void fconfig_reloadenv(void)
 
 	CriticalSection::SafeLock l(fcmutex);
 
+	FETCHENV_BOOL("VGL_ADAPTIVETILES", adaptivetiles);
 	FETCHENV_BOOL("VGL_ALLOWINDIRECT", allowindirect);
 	FETCHENV_BOOL("VGL_AUTOTEST", autotest);
 	FETCHENV_STR("VGL_CLIENT", client);
@@ -350,6 +348,7 @@ void fconfig_reloadenv(void)
 	#ifdef FAKEXCB
 	FETCHENV_BOOL("VGL_FAKEXCB", fakeXCB);
 	#endif
+	FETCHENV_BOOL("VGL_FINGERPRINT", fingerprint);
 	FETCHENV_BOOL("VGL_FORCEALPHA", forcealpha);
 	FETCHENV_DBL("VGL_FPS", fps, 0.0, 1000000.0);
 	if((env = getenv("VGL_GAMMA")) != NULL && strlen(env) > 0)
@@ -384,6 +383,7 @@ void fconfig_reloadenv(void)
 	FETCHENV_BOOL("VGL_GLFLUSHTRIGGER", glflushtrigger);
 	FETCHENV_STR("VGL_GLLIB", gllib);
 	FETCHENV_STR("VGL_GLXVENDOR", glxvendor);
+	FETCHENV_BOOL("VGL_GPUYUV", gpuyuv);
 	FETCHENV_STR("VGL_GUI", guikeyseq);
 	if(strlen(fconfig.guikeyseq) > 0)
 	{
@@ -415,7 +415,7 @@ void fconfig_reloadenv(void)
 	FETCHENV_BOOL("VGL_INTERFRAME", interframe);
 	FETCHENV_STR("VGL_LOG", log);
 	FETCHENV_BOOL("VGL_LOGO", logo);
-	FETCHENV_INT("VGL_NPROCS", np, 1, min(NumProcs(), MAXPROCS));
+	FETCHENV_INT("VGL_NPROCS", np, 1, NumProcs());
 	#ifdef FAKEOPENCL
 	FETCHENV_STR("VGL_OCLLIB", ocllib);
 	#endif
@@ -428,6 +428,9 @@ void fconfig_reloadenv(void)
 		if(!strnicmp(env, "N", 1)) readback = RRREAD_NONE;
 		else if(!strnicmp(env, "P", 1)) readback = RRREAD_PBO;
 		else if(!strnicmp(env, "S", 1)) readback = RRREAD_SYNC;
+		else if(!strnicmp(env, "A", 1)) readback = RRREAD_ASYNC;
+		else if(!strnicmp(env, "M", 1)) readback = RRREAD_MAP;
+		else if(!strnicmp(env, "D", 1)) readback = RRREAD_DIFF;
 		else
 		{
 			char *t = NULL;  int itemp = strtol(env, &t, 10);
@@ -437,6 +440,8 @@ void fconfig_reloadenv(void)
 		if(readback >= 0 && (!fconfig_envset || fconfig_env.readback != readback))
 			fconfig.readback = fconfig_env.readback = readback;
 	}
+	FETCHENV_INT("VGL_REFINE", refine, 0, 1000000);
+	FETCHENV_INT("VGL_REFINEQUAL", refinequal, 0, 100);
 	FETCHENV_DBL("VGL_REFRESHRATE", refreshrate, 0.0, 1000000.0);
 	FETCHENV_INT("VGL_SAMPLES", samples, 0, 64);
 	FETCHENV_BOOL("VGL_SPOIL", spoil);
@@ -600,6 +605,7 @@ void fconfig_setcompress(FakerConfig &fc, int i)
 
 void fconfig_print(FakerConfig &fc)
 {
+	PRCONF_INT(adaptivetiles);
 	PRCONF_INT(allowindirect);
 	PRCONF_STR(client);
 	PRCONF_INT(compress);
@@ -608,6 +614,7 @@ void fconfig_print(FakerConfig &fc)
 	PRCONF_INT(dlsymloader);
 	PRCONF_INT(drawable);
 	PRCONF_STR(excludeddpys);
+	PRCONF_INT(fingerprint);
 	PRCONF_DBL(fps);
 	PRCONF_DBL(flushdelay);
 	PRCONF_INT(forcealpha);
@@ -615,6 +622,7 @@ void fconfig_print(FakerConfig &fc)
 	PRCONF_INT(glflushtrigger);
 	PRCONF_STR(gllib);
 	PRCONF_STR(glxvendor);
+	PRCONF_INT(gpuyuv);
 	PRCONF_INT(gui);
 	PRCONF_INT(guikey);
 	PRCONF_STR(guikeyseq);
@@ -630,6 +638,8 @@ void fconfig_print(FakerConfig &fc)
 	PRCONF_INT(port);
 	PRCONF_INT(qual);
 	PRCONF_INT(readback);
+	PRCONF_INT(refine);
+	PRCONF_INT(refinequal);
 	PRCONF_INT(samples);
 	PRCONF_INT(spoil);
 	PRCONF_INT(spoillast);
@@ -44,6 +44,7 @@ void usage(char **argv)
 	fprintf(stderr, "-tilesize <n> = Width/height of each multithreaded compression/interframe\n");
 	fprintf(stderr, "                comparison tile (default: %d x %d pixels)\n",
 		fconfig.tilesize, fconfig.tilesize);
+	fprintf(stderr, "-adaptive = Send only the changed region of each tile (adaptive tiling)\n");
 	fprintf(stderr, "-rgb = Use RGB (uncompressed) encoding (default is JPEG)\n");
 	#ifdef USESSL
 	fprintf(stderr, "-ssl = Use SSL tunnel (default: %s)\n",
@@ -104,6 +105,7 @@ int main(int argc, char **argv)
 			{
 				fconfig.np = atoi(argv[++i]);
 			}
+			else if(!stricmp(argv[i], "-adaptive")) fconfig.adaptivetiles = 1;
 			else if(!stricmp(argv[i], "-rgb"))
 				fconfig_setcompress(fconfig, RRCOMP_RGB);
 			else usage(argv);
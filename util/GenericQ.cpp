@@ -25,7 +25,7 @@ using namespace vglutil;
 
 GenericQ::GenericQ(void)
 {
-	start = NULL;  end = NULL;
+	start = NULL;  end = NULL;  freeList = NULL;
 	deadYet = 0;
 	#ifdef USEHELGRIND
 	ANNOTATE_BENIGN_RACE_SIZED(&deadYet, sizeof(int), );
@@ -46,6 +46,10 @@ GenericQ::~GenericQ(void)
 			temp = start->next;  delete start;  start = temp;
 		} while(start != NULL);
 	}
+	while(freeList != NULL)
+	{
+		Entry *temp = freeList->next;  delete freeList;  freeList = temp;
+	}
 	mutex.unlock(false);
 }
 
@@ -79,8 +83,13 @@ void GenericQ::add(void *item)
 	if(item == NULL) THROW("NULL argument in GenericQ::add()");
 	CriticalSection::SafeLock l(mutex);
 	if(deadYet) return;
-	Entry *temp = new Entry;
-	if(temp == NULL) THROW("Alloc error");
+	Entry *temp = freeList;
+	if(temp) freeList = temp->next;
+	else
+	{
+		temp = new Entry;
+		if(temp == NULL) THROW("Alloc error");
+	}
 	if(start == NULL) start = temp;
 	else end->next = temp;
 	temp->item = item;  temp->next = NULL;
@@ -102,6 +111,26 @@ void GenericQ::get(void **item, bool nonBlocking)
 		}
 	}
 	else hasItem.wait();
+	remove(item);
+}
+
+
+// This will block until there is something in the queue or until the
+// specified number of seconds has elapsed, in which case *item is set to NULL.
+void GenericQ::timedGet(void **item, double timeout)
+{
+	if(deadYet) return;
+	if(item == NULL) THROW("NULL argument in GenericQ::timedGet()");
+	if(!hasItem.timedWait(timeout))
+	{
+		*item = NULL;  return;
+	}
+	remove(item);
+}
+
+
+void GenericQ::remove(void **item)
+{
 	if(!deadYet)
 	{
 		CriticalSection::SafeLock l(mutex);
@@ -109,7 +138,8 @@ void GenericQ::get(void **item, bool nonBlocking)
 		if(start == NULL) THROW("Nothing in the queue");
 		*item = start->item;
 		Entry *temp = start->next;
-		delete start;  start = temp;
+		start->next = freeList;  freeList = start;
+		start = temp;
 	}
 }
 
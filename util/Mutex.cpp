@@ -15,6 +15,8 @@
 #include "Mutex.h"
 #ifndef _WIN32
 #include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
 #endif
 #include "Error.h"
 
@@ -323,6 +325,59 @@ bool Semaphore::tryWait()
 }
 
 
+// Returns false if the semaphore could not be acquired within the specified
+// number of seconds
+bool Semaphore::timedWait(double timeout)
+{
+	#ifdef _WIN32
+
+	DWORD err = WaitForSingleObject(sem, (DWORD)(timeout * 1000.));
+	if(err == WAIT_FAILED) throw(W32Error("Semaphore::timedWait()"));
+	else if(err == WAIT_TIMEOUT) return false;
+	return true;
+
+	#elif defined(__APPLE__)
+
+	// OS X does not implement sem_timedwait(), so poll the semaphore at 1 ms
+	// intervals.
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	double now = (double)tv.tv_sec + (double)tv.tv_usec * 0.000001,
+		deadline = now + timeout;
+	while(!tryWait())
+	{
+		gettimeofday(&tv, NULL);
+		if((double)tv.tv_sec + (double)tv.tv_usec * 0.000001 >= deadline)
+			return false;
+		usleep(1000);
+	}
+	return true;
+
+	#else
+
+	struct timeval tv;
+	struct timespec ts;
+	gettimeofday(&tv, NULL);
+	long long nsec = (long long)tv.tv_usec * 1000LL +
+		(long long)(timeout * 1000000000.);
+	ts.tv_sec = tv.tv_sec + (time_t)(nsec / 1000000000LL);
+	ts.tv_nsec = (long)(nsec % 1000000000LL);
+	int err = 0;
+	do
+	{
+		err = sem_timedwait(&sem, &ts);
+	} while(err < 0 && errno == EINTR);
+	if(err < 0)
+	{
+		if(errno == ETIMEDOUT) return false;
+		else throw(UnixError("Semaphore::timedWait()"));
+	}
+	return true;
+
+	#endif
+}
+
+
 void Semaphore::post(void)
 {
 	#ifdef _WIN32
@@ -21,8 +21,11 @@
 #else
 	#include <signal.h>
 	#include <unistd.h>
+	#include <fcntl.h>
+	#include <errno.h>
 	#include <sys/types.h>
 	#include <sys/socket.h>
+	#include <sys/uio.h>
 	#include <arpa/inet.h>
 	#include <netdb.h>
 	#include <netinet/tcp.h>
@@ -476,6 +479,89 @@ void Socket::send(char *buf, int len)
 }
 
 
+// Send several buffers using as few system calls as possible.  With a plain
+// TCP connection, the buffers are passed to sendmsg() (or WSASend() on
+// Windows) MAXIOV at a time.  With an SSL connection, consecutive small
+// buffers are coalesced into a single SSL_write() call.
+void Socket::sendv(SockBuf *bufs, int count)
+{
+	if(sd == INVALID_SOCKET) THROW("Not connected");
+	#ifdef USESSL
+	if(doSSL && !ssl) THROW("SSL not connected");
+	if(doSSL)
+	{
+		int batched = 0;
+		for(int i = 0; i < count; i++)
+		{
+			if(bufs[i].len <= 0) continue;
+			if(batched > 0 && bufs[i].len > SSLBATCH - batched)
+			{
+				send(sslBatch, batched);  batched = 0;
+			}
+			if(bufs[i].len >= SSLBATCH) send(bufs[i].buf, bufs[i].len);
+			else
+			{
+				memcpy(&sslBatch[batched], bufs[i].buf, bufs[i].len);
+				batched += bufs[i].len;
+			}
+		}
+		if(batched > 0) send(sslBatch, batched);
+		return;
+	}
+	#endif
+
+	#ifdef _WIN32
+	WSABUF iov[MAXIOV];
+	#define IOV_BASE(v)  (v).buf
+	#define IOV_LEN(v)  (v).len
+	#else
+	struct iovec iov[MAXIOV];
+	#define IOV_BASE(v)  (v).iov_base
+	#define IOV_LEN(v)  (v).iov_len
+	#endif
+	int i = 0;
+	while(i < count)
+	{
+		int n = 0, first = 0;
+		for(; i < count && n < MAXIOV; i++)
+		{
+			if(bufs[i].len <= 0) continue;
+			IOV_BASE(iov[n]) = bufs[i].buf;  IOV_LEN(iov[n]) = bufs[i].len;
+			n++;
+		}
+		while(first < n)
+		{
+			#ifdef _WIN32
+			DWORD retval = 0;
+			if(WSASend(sd, &iov[first], n - first, &retval, 0, NULL,
+				NULL) == SOCKET_ERROR)
+				THROW_SOCK();
+			#else
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = &iov[first];  msg.msg_iovlen = n - first;
+			ssize_t retval = sendmsg(sd, &msg, 0);
+			if(retval == SOCKET_ERROR) THROW_SOCK();
+			#endif
+			if(retval == 0) THROW("Incomplete send");
+			// Skip the buffers that were sent in their entirety, and advance the
+			// start of the buffer that was partially sent.
+			while(first < n && (size_t)retval >= IOV_LEN(iov[first]))
+			{
+				retval -= IOV_LEN(iov[first]);  first++;
+			}
+			if(retval > 0)
+			{
+				IOV_BASE(iov[first]) = (char *)IOV_BASE(iov[first]) + retval;
+				IOV_LEN(iov[first]) -= retval;
+			}
+		}
+	}
+	#undef IOV_BASE
+	#undef IOV_LEN
+}
+
+
 void Socket::recv(char *buf, int len)
 {
 	if(sd == INVALID_SOCKET) THROW("Not connected");
@@ -502,3 +588,112 @@ void Socket::recv(char *buf, int len)
 	}
 	if(bytesRead != len) THROW("Incomplete receive");
 }
+
+
+// Receive as many bytes as are available (up to len) without blocking, and
+// return the number of bytes received.  This is intended for use with
+// non-blocking sockets (see setNonBlocking()), and it returns 0 if no data is
+// available.
+int Socket::recvSome(char *buf, int len)
+{
+	if(sd == INVALID_SOCKET) THROW("Not connected");
+	#ifdef USESSL
+	if(doSSL && !ssl) THROW("SSL not connected");
+	#endif
+	int bytesRead = 0, retval;
+	while(bytesRead < len)
+	{
+		#ifdef USESSL
+		if(doSSL)
+		{
+			retval = SSL_read(ssl, &buf[bytesRead], len - bytesRead);
+			if(retval <= 0)
+			{
+				int err = SSL_get_error(ssl, retval);
+				if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) break;
+				throw(SSLError("Socket::recvSome", ssl, retval));
+			}
+		}
+		else
+		#endif
+		{
+			retval = ::recv(sd, &buf[bytesRead], len - bytesRead, 0);
+			if(retval == SOCKET_ERROR)
+			{
+				#ifdef _WIN32
+				if(WSAGetLastError() == WSAEWOULDBLOCK) break;
+				#else
+				if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+				if(errno == EINTR) continue;
+				#endif
+				THROW_SOCK();
+			}
+			if(retval == 0) THROW("Connection closed by peer");
+		}
+		bytesRead += retval;
+	}
+	return bytesRead;
+}
+
+
+// Send as many bytes as possible (up to len) without blocking, and return the
+// number of bytes sent.  This is intended for use with non-blocking sockets
+// (see setNonBlocking()), and it returns 0 if the send buffer is full.  With an
+// SSL connection, a send that returns 0 must be retried using the same buffer
+// and at least the same length.
+int Socket::sendSome(char *buf, int len)
+{
+	if(sd == INVALID_SOCKET) THROW("Not connected");
+	#ifdef USESSL
+	if(doSSL && !ssl) THROW("SSL not connected");
+	#endif
+	int bytesSent = 0, retval;
+	while(bytesSent < len)
+	{
+		#ifdef USESSL
+		if(doSSL)
+		{
+			retval = SSL_write(ssl, &buf[bytesSent], len - bytesSent);
+			if(retval <= 0)
+			{
+				int err = SSL_get_error(ssl, retval);
+				if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) break;
+				throw(SSLError("Socket::sendSome", ssl, retval));
+			}
+		}
+		else
+		#endif
+		{
+			retval = ::send(sd, &buf[bytesSent], len - bytesSent, 0);
+			if(retval == SOCKET_ERROR)
+			{
+				#ifdef _WIN32
+				if(WSAGetLastError() == WSAEWOULDBLOCK) break;
+				#else
+				if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+				if(errno == EINTR) continue;
+				#endif
+				THROW_SOCK();
+			}
+			if(retval == 0) break;
+		}
+		bytesSent += retval;
+	}
+	return bytesSent;
+}
+
+
+void Socket::setNonBlocking(bool nonBlocking)
+{
+	if(sd == INVALID_SOCKET) THROW("Not connected");
+	#ifdef _WIN32
+	u_long mode = nonBlocking ? 1 : 0;
+	TRY_SOCK(ioctlsocket(sd, FIONBIO, &mode));
+	#else
+	int flags;
+	TRY_SOCK(flags = fcntl(sd, F_GETFL, 0));
+	if(nonBlocking) flags |= O_NONBLOCK;
+	else flags &= ~O_NONBLOCK;
+	TRY_SOCK(fcntl(sd, F_SETFL, flags));
+	#endif
+}
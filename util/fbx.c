@@ -30,6 +30,8 @@
 static int errorLine = -1;
 static FILE *warningFile = NULL;
 
+static int freeBuffers(fbx_struct *fb);
+
 
 #if defined(_WIN32)
 
@@ -151,6 +153,7 @@ int fbx_init(fbx_struct *fb, fbx_wh wh, int width_, int height_, int useShm)
 	BMINFO bminfo;  HBITMAP hmembmp = 0;  RECT rect;  HDC hdc = NULL;
 	#else
 	XWindowAttributes xwa;  int shmok = 1, pixmap = 0;
+	int resizes = 0, shmAllocs = 0;  size_t shmSize = 0;
 	#endif
 
 	if(!fb) THROW("Invalid argument");
@@ -269,10 +272,35 @@ int fbx_init(fbx_struct *fb, fbx_wh wh, int width_, int height_, int useShm)
 		if(width == fb->width && height == fb->height && fb->xi && fb->xgc
 			&& fb->bits)
 			return 0;
-		else if(fbx_term(fb) == -1) return -1;
+		#ifdef USESHM
+		/* If the window is resized, then reuse the existing shared memory segment
+		   if it is large enough.  Only the XImage header needs to be re-created in
+		   that case.  This isn't possible with MIT-SHM pixmaps, since their size
+		   is fixed. */
+		if(fb->shm && !fb->pm && fb->xi && fb->xgc && fb->bits)
+		{
+			XImage *xi = XShmCreateImage(fb->wh.dpy, xwa.visual, xwa.depth, ZPixmap,
+				NULL, &fb->shminfo, width, height);
+			if(xi && xi->width == width && xi->height == height
+				&& (size_t)xi->bytes_per_line * xi->height + 1 <= fb->shmSize)
+			{
+				XDestroyImage(fb->xi);
+				fb->xi = xi;  fb->xi->data = fb->shminfo.shmaddr;
+				fb->width = xi->width;  fb->height = xi->height;
+				fb->pitch = xi->bytes_per_line;
+				fb->resizes++;
+				return 0;
+			}
+			if(xi) XDestroyImage(xi);
+		}
+		#endif
+		resizes = fb->resizes + 1;  shmAllocs = fb->shmAllocs;
+		shmSize = fb->shmSize;
+		if(freeBuffers(fb) == -1) return -1;
 	}
 	memset(fb, 0, sizeof(fbx_struct));
 	fb->wh.dpy = wh.dpy;  fb->wh.d = wh.d;
+	fb->resizes = resizes;  fb->shmAllocs = shmAllocs;
 
 	#ifdef USESHM
 	if(!useShm)
@@ -293,8 +321,14 @@ int fbx_init(fbx_struct *fb, fbx_wh wh, int width_, int height_, int useShm)
 		{
 			useShm = 0;  goto noshm;
 		}
-		if((fb->shminfo.shmid = shmget(IPC_PRIVATE,
-			fb->xi->bytes_per_line * fb->xi->height + 1, IPC_CREAT | 0777)) == -1)
+		/* If the buffer is being re-created because the window has grown, then
+		   over-allocate the new segment so that further growth (for instance,
+		   while the window is being interactively resized) can reuse it. */
+		fb->shmSize = (size_t)fb->xi->bytes_per_line * fb->xi->height + 1;
+		if(shmSize > 0 && fb->shmSize < shmSize + shmSize / 2)
+			fb->shmSize = shmSize + shmSize / 2;
+		if((fb->shminfo.shmid = shmget(IPC_PRIVATE, fb->shmSize,
+			IPC_CREAT | 0777)) == -1)
 		{
 			useShm = 0;  XDestroyImage(fb->xi);  goto noshm;
 		}
@@ -345,7 +379,7 @@ int fbx_init(fbx_struct *fb, fbx_wh wh, int width_, int height_, int useShm)
 			useShm = 0;  XDestroyImage(fb->xi);  shmdt(fb->shminfo.shmaddr);
 			shmctl(fb->shminfo.shmid, IPC_RMID, 0);  goto noshm;
 		}
-		fb->xattach = 1;  fb->shm = 1;
+		fb->xattach = 1;  fb->shm = 1;  fb->shmAllocs++;
 	}
 	else if(useShm)
 	{
@@ -418,7 +452,7 @@ int fbx_init(fbx_struct *fb, fbx_wh wh, int width_, int height_, int useShm)
 
 	#endif
 
-	fbx_term(fb);
+	freeBuffers(fb);
 	return -1;
 }
 
@@ -602,7 +636,11 @@ int fbx_awrite(fbx_struct *fb, int srcX_, int srcY_, int dstX_, int dstY_,
 	#endif
 	{
 		Drawable draw = fb->pixmap ? fb->wh.d : fb->pm;
-		if(draw == fb->pm) dstX = dstY = 0;
+		if(draw == fb->pm)
+		{
+			/* The pixmap mirrors the whole frame (see fbx_sync()) */
+			dstX = srcX;  dstY = srcY;
+		}
 		XPutImage(fb->wh.dpy, draw, fb->xgc, fb->xi, srcX, srcY, dstX, dstY, width,
 			height);
 	}
@@ -640,7 +678,7 @@ int fbx_sync(fbx_struct *fb)
 }
 
 
-int fbx_term(fbx_struct *fb)
+static int freeBuffers(fbx_struct *fb)
 {
 	if(!fb) THROW("Invalid argument");
 
@@ -684,3 +722,21 @@ int fbx_term(fbx_struct *fb)
 	finally:
 	return -1;
 }
+
+
+int fbx_term(fbx_struct *fb)
+{
+	if(!fb) THROW("Invalid argument");
+
+	#ifndef _WIN32
+	if(fb->resizes > 0 && warningFile)
+		fprintf(warningFile,
+			"[FBX] Drawable 0x%.8lx: %d resizes, %d shared memory segments allocated\n",
+			fb->wh.d, fb->resizes, fb->shmAllocs);
+	#endif
+
+	return freeBuffers(fb);
+
+	finally:
+	return -1;
+}
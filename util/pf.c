@@ -15,6 +15,17 @@
 #include "boost/endian.h"
 #include "vglutil.h"
 #include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+	&& (__GNUC__ >= 5 || defined(__clang__))
+#define GAMMA_X86
+#if __GNUC__ >= 8 || defined(__clang__)
+#define GAMMA_AVX512
+#endif
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define GAMMA_NEON
+#include <arm_neon.h>
+#endif
 
 
 #define PF_RGB_SIZE          3
@@ -587,3 +598,241 @@ PF *pf_get(int id)
 		default:  return &__format_NONE;
 	}
 }
+
+
+/* Gamma correction
+
+   8-bit formats are corrected one byte at a time (including the padding
+   bytes.)  The scalar implementation corrects two bytes at a time, using a
+   65536-entry LUT.  The compiler vectorizes it well enough that it is faster
+   than looking up nibbles in a 256-entry LUT using SSE4.1 or AVX2 shuffles, so
+   those instruction sets are used only with 10-bit formats.  The AVX-512 VBMI
+   implementation looks up the low 7 bits of each byte in two 128-entry tables
+   and selects the result using the high bit, and the NEON implementation uses
+   four 64-entry table lookups.  10-bit formats are corrected one component at
+   a time, using a 1024-entry LUT.  The AVX2 implementation uses gathers, and
+   the SSE4.1 implementation extracts the components using SIMD instructions
+   and looks them up using scalar instructions.  The padding bits of 10-bit
+   pixels are cleared.  The scalar implementations declare their pointers as
+   non-aliasing so that the compiler can vectorize them. */
+
+static void gamma8_c(unsigned char *buf, int n, const unsigned char *lut,
+	const unsigned short *__restrict lut16)
+{
+	unsigned short *__restrict ptr = (unsigned short *)buf, *end = ptr + n / 2;
+
+	for(; ptr < end; ptr++) *ptr = lut16[*ptr];
+	if(n % 2 != 0) buf[n - 1] = lut[buf[n - 1]];
+}
+
+/* Used to correct the bytes left over by the SIMD implementations */
+static void gamma8_tail(unsigned char *buf, int n, const unsigned char *lut)
+{
+	while(n--)
+	{
+		*buf = lut[*buf];  buf++;
+	}
+}
+
+static void gamma10_c(unsigned int *__restrict buf, int n,
+	const unsigned int *__restrict lut, PF *pf)
+{
+	int rshift = pf->rshift, gshift = pf->gshift, bshift = pf->bshift;
+
+	while(n--)
+	{
+		unsigned int p = *buf;
+		*buf++ = (lut[(p >> rshift) & 1023] << rshift)
+			| (lut[(p >> gshift) & 1023] << gshift)
+			| (lut[(p >> bshift) & 1023] << bshift);
+	}
+}
+
+#ifdef GAMMA_X86
+
+#ifdef GAMMA_AVX512
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static void gamma8_avx512(unsigned char *buf, int n, const unsigned char *lut,
+	const unsigned short *lut16)
+{
+	__m512i t0 = _mm512_loadu_si512(&lut[0]), t1 = _mm512_loadu_si512(&lut[64]),
+		t2 = _mm512_loadu_si512(&lut[128]), t3 = _mm512_loadu_si512(&lut[192]);
+
+	for(; n >= 64; n -= 64, buf += 64)
+	{
+		__m512i x = _mm512_loadu_si512(buf),
+			lo = _mm512_permutex2var_epi8(t0, x, t1),
+			hi = _mm512_permutex2var_epi8(t2, x, t3);
+		_mm512_storeu_si512(buf,
+			_mm512_mask_blend_epi8(_mm512_movepi8_mask(x), lo, hi));
+	}
+	gamma8_tail(buf, n, lut);
+}
+
+#endif
+
+__attribute__((target("sse4.1")))
+static void gamma10_sse41(unsigned int *buf, int n, const unsigned int *lut,
+	PF *pf)
+{
+	__m128i rs = _mm_cvtsi32_si128(pf->rshift), gs = _mm_cvtsi32_si128(pf->gshift),
+		bs = _mm_cvtsi32_si128(pf->bshift), mask = _mm_set1_epi32(1023);
+
+	for(; n >= 4; n -= 4, buf += 4)
+	{
+		__m128i p = _mm_loadu_si128((__m128i *)buf),
+			ri = _mm_and_si128(_mm_srl_epi32(p, rs), mask),
+			gi = _mm_and_si128(_mm_srl_epi32(p, gs), mask),
+			bi = _mm_and_si128(_mm_srl_epi32(p, bs), mask),
+			r = _mm_setr_epi32(lut[_mm_extract_epi32(ri, 0)],
+				lut[_mm_extract_epi32(ri, 1)], lut[_mm_extract_epi32(ri, 2)],
+				lut[_mm_extract_epi32(ri, 3)]),
+			g = _mm_setr_epi32(lut[_mm_extract_epi32(gi, 0)],
+				lut[_mm_extract_epi32(gi, 1)], lut[_mm_extract_epi32(gi, 2)],
+				lut[_mm_extract_epi32(gi, 3)]),
+			b = _mm_setr_epi32(lut[_mm_extract_epi32(bi, 0)],
+				lut[_mm_extract_epi32(bi, 1)], lut[_mm_extract_epi32(bi, 2)],
+				lut[_mm_extract_epi32(bi, 3)]);
+		_mm_storeu_si128((__m128i *)buf,
+			_mm_or_si128(_mm_or_si128(_mm_sll_epi32(r, rs), _mm_sll_epi32(g, gs)),
+				_mm_sll_epi32(b, bs)));
+	}
+	gamma10_c(buf, n, lut, pf);
+}
+
+__attribute__((target("avx2")))
+static void gamma10_avx2(unsigned int *buf, int n, const unsigned int *lut,
+	PF *pf)
+{
+	__m128i rs = _mm_cvtsi32_si128(pf->rshift), gs = _mm_cvtsi32_si128(pf->gshift),
+		bs = _mm_cvtsi32_si128(pf->bshift);
+	__m256i mask = _mm256_set1_epi32(1023);
+
+	for(; n >= 8; n -= 8, buf += 8)
+	{
+		__m256i p = _mm256_loadu_si256((__m256i *)buf),
+			r = _mm256_i32gather_epi32((const int *)lut,
+				_mm256_and_si256(_mm256_srl_epi32(p, rs), mask), 4),
+			g = _mm256_i32gather_epi32((const int *)lut,
+				_mm256_and_si256(_mm256_srl_epi32(p, gs), mask), 4),
+			b = _mm256_i32gather_epi32((const int *)lut,
+				_mm256_and_si256(_mm256_srl_epi32(p, bs), mask), 4);
+		_mm256_storeu_si256((__m256i *)buf,
+			_mm256_or_si256(_mm256_or_si256(_mm256_sll_epi32(r, rs),
+				_mm256_sll_epi32(g, gs)), _mm256_sll_epi32(b, bs)));
+	}
+	gamma10_c(buf, n, lut, pf);
+}
+
+#endif  /* GAMMA_X86 */
+
+#ifdef GAMMA_NEON
+
+static void gamma8_neon(unsigned char *buf, int n, const unsigned char *lut,
+	const unsigned short *lut16)
+{
+	uint8x16x4_t tables[4];
+	uint8x16_t step = vdupq_n_u8(64);
+	int i, j;
+
+	for(i = 0; i < 4; i++)
+		for(j = 0; j < 4; j++)
+			tables[i].val[j] = vld1q_u8(&lut[i * 64 + j * 16]);
+	for(; n >= 16; n -= 16, buf += 16)
+	{
+		uint8x16_t idx = vld1q_u8(buf), result = vqtbl4q_u8(tables[0], idx);
+		idx = vsubq_u8(idx, step);
+		result = vqtbx4q_u8(result, tables[1], idx);
+		idx = vsubq_u8(idx, step);
+		result = vqtbx4q_u8(result, tables[2], idx);
+		idx = vsubq_u8(idx, step);
+		result = vqtbx4q_u8(result, tables[3], idx);
+		vst1q_u8(buf, result);
+	}
+	gamma8_tail(buf, n, lut);
+}
+
+#endif  /* GAMMA_NEON */
+
+static void (*gamma8)(unsigned char *, int, const unsigned char *,
+	const unsigned short *) = gamma8_c;
+static void (*gamma10)(unsigned int *, int, const unsigned int *, PF *) =
+	gamma10_c;
+static const char *gammaSIMD = NULL;
+
+
+const char *pf_gammainit(int simd)
+{
+	int avx512 = 0, avx2 = 0, sse41 = 0, neon = 0;
+
+	#if defined(GAMMA_X86)
+	__builtin_cpu_init();
+	#ifdef GAMMA_AVX512
+	avx512 = __builtin_cpu_supports("avx512bw")
+		&& __builtin_cpu_supports("avx512vbmi");
+	#endif
+	avx2 = __builtin_cpu_supports("avx2");
+	sse41 = __builtin_cpu_supports("sse4.1");
+	#elif defined(GAMMA_NEON)
+	neon = 1;
+	#endif
+
+	if(simd == PF_GAMMA_AUTO)
+		simd = avx512 ? PF_GAMMA_AVX512 : avx2 ? PF_GAMMA_AVX2 :
+			sse41 ? PF_GAMMA_SSE41 : neon ? PF_GAMMA_NEON : PF_GAMMA_NONE;
+
+	switch(simd)
+	{
+		case PF_GAMMA_NONE:
+			gamma8 = gamma8_c;  gamma10 = gamma10_c;  gammaSIMD = "None";
+			break;
+		#ifdef GAMMA_X86
+		#ifdef GAMMA_AVX512
+		case PF_GAMMA_AVX512:
+			if(!avx512) return NULL;
+			gamma8 = gamma8_avx512;  gamma10 = gamma10_avx2;
+			gammaSIMD = "AVX-512 VBMI";
+			break;
+		#endif
+		case PF_GAMMA_AVX2:
+			if(!avx2) return NULL;
+			gamma8 = gamma8_c;  gamma10 = gamma10_avx2;  gammaSIMD = "AVX2";
+			break;
+		case PF_GAMMA_SSE41:
+			if(!sse41) return NULL;
+			gamma8 = gamma8_c;  gamma10 = gamma10_sse41;  gammaSIMD = "SSE4.1";
+			break;
+		#endif
+		#ifdef GAMMA_NEON
+		case PF_GAMMA_NEON:
+			/* Without a gather instruction, the scalar lookups dominate the 10-bit
+			   conversion, so only the 8-bit conversion uses NEON. */
+			gamma8 = gamma8_neon;  gamma10 = gamma10_c;  gammaSIMD = "NEON";
+			break;
+		#endif
+		default:
+			return NULL;
+	}
+	return gammaSIMD;
+}
+
+
+void pf_gamma(PF *pf, unsigned char *buf, int width, int pitch, int height,
+	const unsigned char *lut, const unsigned short *lut16,
+	const unsigned int *lut10)
+{
+	int rowSize = width * pf->size;
+
+	if(!gammaSIMD) pf_gammainit(PF_GAMMA_AUTO);
+	if(pitch == rowSize)
+	{
+		rowSize *= height;  height = 1;
+	}
+	for(; height > 0; height--, buf += pitch)
+	{
+		if(pf->bpc == 10)
+			gamma10((unsigned int *)buf, rowSize / pf->size, lut10, pf);
+		else gamma8(buf, rowSize, lut, lut16);
+	}
+}
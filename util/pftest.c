@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <sys/types.h>
 #include "pf.h"
 #include "vglutil.h"
@@ -30,7 +31,7 @@
 
 
 double testTime = BENCHTIME;
-int getSetRGB = 0;
+int getSetRGB = 0, doGamma = 0;
 
 
 static void initBuf(unsigned char *buf, int width, int pitch, int height,
@@ -184,13 +185,137 @@ static int doTest(int width, int height, PF *srcpf, PF *dstpf)
 }
 
 
+/* The gamma correction algorithm used by VirtualGL 2.6.5 and earlier, which
+   is the baseline for the gamma correction benchmark.  8-bit formats are
+   corrected two bytes at a time, using a 65536-entry LUT.  The benchmark
+   alternates between a gamma correction factor and its inverse, so the pixel
+   values do not converge (which would flatter the larger LUT.) */
+
+static unsigned char lut[2][256];
+static unsigned short lut16[2][65536];
+static unsigned int lut10[2][1024];
+
+static void initGammaLUTs(double g)
+{
+	int i, j;
+
+	for(j = 0; j < 2; j++, g = 1.0 / g)
+	{
+		for(i = 0; i < 256; i++)
+			lut[j][i] = (unsigned char)(255. * pow((double)i / 255., g) + 0.5);
+		for(i = 0; i < 1024; i++)
+			lut10[j][i] = (unsigned int)(1023. * pow((double)i / 1023., g) + 0.5);
+		for(i = 0; i < 65536; i++)
+			lut16[j][i] = (unsigned short)(lut[j][i / 256] << 8) | lut[j][i % 256];
+	}
+}
+
+static void gammaLegacy(PF *pf, unsigned char *bits, int width, int pitch,
+	int height, int j)
+{
+	if(pf->bpc == 10)
+	{
+		int h = height;
+		while(h--)
+		{
+			int w = width;
+			unsigned int *srcPixel = (unsigned int *)bits;
+			while(w--)
+			{
+				unsigned int r = lut10[j][(*srcPixel >> pf->rshift) & 1023];
+				unsigned int g = lut10[j][(*srcPixel >> pf->gshift) & 1023];
+				unsigned int b = lut10[j][(*srcPixel >> pf->bshift) & 1023];
+				*srcPixel++ =
+					(r << pf->rshift) | (g << pf->gshift) | (b << pf->bshift);
+			}
+			bits += pitch;
+		}
+	}
+	else
+	{
+		unsigned short *ptr1, *ptr2 = (unsigned short *)(&bits[pitch * height]);
+		for(ptr1 = (unsigned short *)bits; ptr1 < ptr2; ptr1++)
+			*ptr1 = lut16[j][*ptr1];
+		if((pitch * height) % 2 != 0)
+			bits[pitch * height - 1] = lut[j][bits[pitch * height - 1]];
+	}
+}
+
+
+/* simd = -1: legacy algorithm, otherwise: pf_gamma() using the specified
+   implementation (PF_GAMMA_*), which is skipped if the CPU does not support
+   it */
+
+static int doGammaTest(int width, int height, PF *pf, int simd)
+{
+	int retval = 0, iter = 0, pitch = BMPPAD(width * pf->size), i, j;
+	unsigned char *refBuf = NULL, *buf = NULL;
+	double tStart, elapsed;
+	const char *simdName = NULL;
+	char label[80];
+
+	if(simd >= 0 && (simdName = pf_gammainit(simd)) == NULL) return 0;
+
+	if((refBuf = (unsigned char *)malloc(pitch * height)) == NULL
+		|| (buf = (unsigned char *)malloc(pitch * height)) == NULL)
+		THROW("Could not allocate memory");
+	initBuf(refBuf, width, pitch, height, pf, pf);
+	memcpy(buf, refBuf, pitch * height);
+
+	if(simd < 0) snprintf(label, 80, "%s", "legacy");
+	else snprintf(label, 80, "pf_gamma/%s", simdName);
+	printf("%-8s (%-21s):  ", pf->name, label);
+
+	if(simd >= 0)
+	{
+		gammaLegacy(pf, refBuf, width, pitch, height, 0);
+		pf_gamma(pf, buf, width, pitch, height, lut[0], lut16[0], lut10[0]);
+		for(j = 0; j < height; j++)
+		{
+			for(i = 0; i < width; i++)
+			{
+				int r, g, b, rr, rg, rb;
+				pf->getRGB(&buf[j * pitch + i * pf->size], &r, &g, &b);
+				pf->getRGB(&refBuf[j * pitch + i * pf->size], &rr, &rg, &rb);
+				if(r != rr || g != rg || b != rb)
+				{
+					printf("Pixel data is bogus\n");
+					retval = -1;  goto bailout;
+				}
+			}
+		}
+		iter++;
+	}
+
+	tStart = GetTime();
+	do
+	{
+		if(simd < 0) gammaLegacy(pf, buf, width, pitch, height, iter % 2);
+		else
+			pf_gamma(pf, buf, width, pitch, height, lut[iter % 2], lut16[iter % 2],
+				lut10[iter % 2]);
+		iter++;
+	} while((elapsed = GetTime() - tStart) < testTime);
+	if(simd >= 0) iter--;
+
+	printf("%f Mpixels/sec\n",
+		(double)(width * height) / 1000000. * (double)iter / elapsed);
+
+	bailout:
+	free(refBuf);
+	free(buf);
+	return retval;
+}
+
+
 static void usage(char **argv)
 {
 	fprintf(stderr, "\nUSAGE: %s [options]\n\n", argv[0]);
 	fprintf(stderr, "Options:\n");
 	fprintf(stderr, "-time <t> = Set benchmark time to <t> seconds (default: %.1f)\n",
 		BENCHTIME);
-	fprintf(stderr, "-getsetrgb = Use pixel format getRGB/setRGB methods for conversion\n\n");
+	fprintf(stderr, "-getsetrgb = Use pixel format getRGB/setRGB methods for conversion\n");
+	fprintf(stderr, "-gamma = Benchmark gamma correction instead of pixel format conversion\n\n");
 	exit(1);
 }
 
@@ -208,9 +333,31 @@ int main(int argc, char **argv)
 			if(testTime <= 0.0) usage(argv);
 		}
 		else if(!stricmp(argv[i], "-getsetrgb")) getSetRGB = 1;
+		else if(!stricmp(argv[i], "-gamma")) doGamma = 1;
 		else usage(argv);
 	}
 
+	if(doGamma)
+	{
+		initGammaLUTs(1.0 / 2.2);
+		for(srcFormat = 0; srcFormat < PIXELFORMATS - 1; srcFormat++)
+		{
+			PF *pf = pf_get(srcFormat);
+			/* Test the legacy algorithm, the scalar implementation, and every
+			   SIMD implementation that the CPU supports */
+			if(doGammaTest(width, height, pf, -1) == -1
+				|| doGammaTest(width, height, pf, PF_GAMMA_NONE) == -1)
+				goto bailout;
+			for(i = PF_GAMMA_SSE41; i <= PF_GAMMA_NEON; i++)
+			{
+				if(doGammaTest(width, height, pf, i) == -1)
+					goto bailout;
+			}
+			printf("\n");
+		}
+		goto bailout;
+	}
+
 	for(srcFormat = 0; srcFormat < PIXELFORMATS - 1; srcFormat++)
 	{
 		PF *srcpf = pf_get(srcFormat);